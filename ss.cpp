@@ -11,9 +11,13 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <list>
 #include <stdio.h>
 #include <sys/time.h>
 #include <climits>
+#include <cmath>
+#include <algorithm>
+#include <queue>
 
 #include "ns3/core-module.h"
 //#include "ns3/common-module.h"
@@ -463,6 +467,8 @@ private:
 	const uint32_t 				m_contractMethodId;
 	const RandomVariable 		m_requestSize;
 	const double				m_stepProbability;
+	// parallel step group - 0 if the step is executed sequentially
+	const uint32_t				m_parallelGroup;
 
 public:
 
@@ -470,11 +476,13 @@ public:
 			uint32_t contractId,
 			uint32_t contractMethodId,
 			RandomVariable requestSize,
-			double stepProbability)
+			double stepProbability,
+			uint32_t parallelGroup)
 		:m_contractId (contractId),
 		 m_contractMethodId (contractMethodId),
 		 m_requestSize (requestSize),
-		 m_stepProbability (stepProbability)
+		 m_stepProbability (stepProbability),
+		 m_parallelGroup (parallelGroup)
 	{
 		NS_ASSERT(contractId != 0);
 		NS_ASSERT(contractMethodId != 0);
@@ -487,18 +495,87 @@ public:
 	uint32_t GetContractMethodId () const { return m_contractMethodId; }
 	const RandomVariable GetRequestSize () const { return m_requestSize; }
 	const double GetStepProbability () const { return m_stepProbability; }
+	uint32_t GetParallelGroup () const { return m_parallelGroup; }
 
 }; // ExecutionStep
 
 
+/*
+ * Parallel step groups
+ * 		Consecutive steps with the same (non zero) parallel group form a group. Steps of the group
+ * 		are selected independently by their step probability and the selected calls are issued
+ * 		concurrently. The join policy of the group decides when the group is completed:
+ * 			JoinAll - all calls succeeded (fails on the first failure)
+ * 			JoinFirstSuccess - the first call succeeded (fails when all calls failed)
+ * 			JoinKOfN - k calls succeeded (fails when k successes are no longer reachable)
+ * 		Calls still outstanding when the group is decided are abandoned.
+ *
+ * Hedged steps
+ * 		A sequential step may be hedged - when its request is not answered within the hedging delay,
+ * 		a copy is sent to another replica of the contract and the first successful response is taken,
+ * 		the other request is abandoned. The delay is fixed or the given percentile of recently observed
+ * 		response times of the contract (the fixed delay until enough responses are observed).
+ *
+ * Compiled plan
+ * 		Finalize compiles the plan once it is complete - the plan is immutable afterwards.
+ * 		Attributes of steps are flattened to contiguous arrays (one per attribute) indexed by step,
+ * 		executers read them by reference without touching step objects.
+ *
+ * Step selection
+ * 		Selection tables are built by Finalize as well.
+ * 		SelectStep - a single step with probability proportional to step probabilities (alias method),
+ * 			two uniform draws, constant time.
+ * 		SelectNextStep - the first step selected when steps from the given one are selected
+ * 			independently by their step probability. Products of non selection probabilities since
+ * 			the latest certain step (probability 100) are cumulated, the inverse of the resulting
+ * 			distribution is found by binary search - one uniform draw.
+ */
 class ExecutionPlan : public Object
 {
+public:
+	enum JoinPolicy
+	{
+		JoinAll,
+		JoinFirstSuccess,
+		JoinKOfN
+	};
+
+	struct GroupJoin
+	{
+		JoinPolicy		policy;
+		uint32_t		k;
+	};
+
+	// percentile 0 - the delay is fixed
+	struct StepHedging
+	{
+		Time			delay;
+		double			percentile;
+	};
+
 private:
 	vector<Ptr<ExecutionStep> > 		m_executionSteps;
+	map<uint32_t, GroupJoin>			m_groupJoins;
+	// key is step index
+	map<uint32_t, StepHedging>			m_hedgings;
+	// compiled steps and selection tables - valid only if finalized
+	bool								m_isFinalized;
+	vector<uint32_t>					m_stepContractIds;
+	vector<uint32_t>					m_stepContractMethodIds;
+	vector<double>						m_stepProbabilities;
+	vector<RandomVariable>				m_stepRequestSizes;
+	vector<uint32_t>					m_stepParallelGroups;
+	vector<bool>						m_stepIsHedged;
+	vector<StepHedging>					m_stepHedgings;
+	vector<double>						m_aliasProbability;
+	vector<uint32_t>					m_aliasIndex;
+	vector<double>						m_skipProduct;
+	vector<uint32_t>					m_nextCertainStep;
 
 public:
 
 	ExecutionPlan ()
+		:m_isFinalized (false)
 	{}
 
 	virtual ~ExecutionPlan() {}
@@ -507,21 +584,258 @@ public:
 	const Ptr<ExecutionStep> GetExecutionStep (uint32_t index) const { return m_executionSteps[index]; }
 	const uint32_t GetExecutionStepsCount () const { return m_executionSteps.size(); }
 
+	// compiled steps
+	uint32_t GetStepContractId (uint32_t index) const { return m_stepContractIds[index]; }
+	uint32_t GetStepContractMethodId (uint32_t index) const { return m_stepContractMethodIds[index]; }
+	double GetStepProbability (uint32_t index) const { return m_stepProbabilities[index]; }
+	const RandomVariable & GetStepRequestSize (uint32_t index) const { return m_stepRequestSizes[index]; }
+	uint32_t GetStepParallelGroup (uint32_t index) const { return m_stepParallelGroups[index]; }
+	bool IsStepHedged (uint32_t index) const { return m_stepIsHedged[index]; }
+	const StepHedging & GetStepHedging (uint32_t index) const { return m_stepHedgings[index]; }
+
 	virtual void AddExecutionStep (
 			uint32_t contractId,
 			uint32_t contractMethodId,
 			RandomVariable requestSize,
-			double stepProbability)
+			double stepProbability,
+			uint32_t parallelGroup = 0)
 	{
 		Ptr<ExecutionStep> executionStep = CreateObject<ExecutionStep> (
 				contractId,
 				contractMethodId,
 				requestSize,
-				stepProbability);
+				stepProbability,
+				parallelGroup);
+
+		NS_ASSERT(!m_isFinalized);
 
 		m_executionSteps.push_back( executionStep );
 	}
 
+	bool IsFinalized () const { return m_isFinalized; }
+
+	void Finalize ()
+	{
+		uint32_t				stepsCount = m_executionSteps.size();
+		double					probabilitySum = 0;
+		double					stepProbability;
+		vector<double>			scaledProbability (stepsCount);
+		vector<uint32_t>		small;
+		vector<uint32_t>		large;
+		uint32_t				s;
+		uint32_t				l;
+		StepHedging				noHedging;
+
+
+		NS_ASSERT(!m_isFinalized);
+
+		noHedging.delay = Seconds(0);
+		noHedging.percentile = 0;
+
+		m_stepContractIds.resize(stepsCount);
+		m_stepContractMethodIds.resize(stepsCount);
+		m_stepProbabilities.resize(stepsCount);
+		m_stepRequestSizes.resize(stepsCount);
+		m_stepParallelGroups.resize(stepsCount);
+		m_stepIsHedged.assign(stepsCount, false);
+		m_stepHedgings.assign(stepsCount, noHedging);
+
+		for (uint32_t i = 0; i < stepsCount; i++)
+		{
+			m_stepContractIds[i] = m_executionSteps[i]->GetContractId();
+			m_stepContractMethodIds[i] = m_executionSteps[i]->GetContractMethodId();
+			m_stepProbabilities[i] = m_executionSteps[i]->GetStepProbability();
+			m_stepRequestSizes[i] = m_executionSteps[i]->GetRequestSize();
+			m_stepParallelGroups[i] = m_executionSteps[i]->GetParallelGroup();
+		}
+
+		for (map<uint32_t, StepHedging>::const_iterator it = m_hedgings.begin(); it != m_hedgings.end(); it++)
+		{
+			// calls of parallel groups are not hedged
+			NS_ASSERT(it->first < stepsCount);
+			NS_ASSERT(m_stepParallelGroups[it->first] == 0);
+
+			m_stepIsHedged[it->first] = true;
+			m_stepHedgings[it->first] = it->second;
+		}
+
+		m_aliasProbability.assign(stepsCount, 1);
+		m_aliasIndex.resize(stepsCount);
+		m_skipProduct.resize(stepsCount + 1);
+		m_nextCertainStep.resize(stepsCount);
+
+		// alias table
+		for (uint32_t i = 0; i < stepsCount; i++)
+		{
+			probabilitySum += m_stepProbabilities[i];
+			m_aliasIndex[i] = i;
+		}
+
+		for (uint32_t i = 0; i < stepsCount; i++)
+		{
+			scaledProbability[i] = m_stepProbabilities[i] * stepsCount / probabilitySum;
+
+			if (scaledProbability[i] < 1)
+			{
+				small.push_back(i);
+			}
+			else
+			{
+				large.push_back(i);
+			}
+		}
+
+		while (!small.empty() && !large.empty())
+		{
+			s = small.back();
+			small.pop_back();
+			l = large.back();
+			large.pop_back();
+
+			m_aliasProbability[s] = scaledProbability[s];
+			m_aliasIndex[s] = l;
+
+			scaledProbability[l] = scaledProbability[l] + scaledProbability[s] - 1;
+
+			if (scaledProbability[l] < 1)
+			{
+				small.push_back(l);
+			}
+			else
+			{
+				large.push_back(l);
+			}
+		}
+
+		// cumulated non selection - restarted after each certain step
+		m_skipProduct[0] = 1;
+
+		for (uint32_t i = 0; i < stepsCount; i++)
+		{
+			stepProbability = m_stepProbabilities[i];
+
+			m_skipProduct[i + 1] = (stepProbability >= 100) ? 1 : m_skipProduct[i] * (1 - stepProbability / 100);
+		}
+
+		for (uint32_t i = stepsCount; i > 0; i--)
+		{
+			if (m_stepProbabilities[i - 1] >= 100)
+			{
+				m_nextCertainStep[i - 1] = i - 1;
+			}
+			else
+			{
+				m_nextCertainStep[i - 1] = (i == stepsCount) ? stepsCount : m_nextCertainStep[i];
+			}
+		}
+
+		m_isFinalized = true;
+	}
+
+	// uniform1, uniform2 from [0, 1)
+	uint32_t SelectStep (double uniform1, double uniform2) const
+	{
+		NS_ASSERT(m_isFinalized);
+		NS_ASSERT(!m_executionSteps.empty());
+
+		uint32_t		step = min((uint32_t)(uniform1 * m_executionSteps.size()), (uint32_t)m_executionSteps.size() - 1);
+
+
+		return (uniform2 < m_aliasProbability[step]) ? step : m_aliasIndex[step];
+	}
+
+	// uniform from [0, 1) - returns steps count if no step is selected
+	uint32_t SelectNextStep (uint32_t fromStep, double uniform) const
+	{
+		NS_ASSERT(m_isFinalized);
+
+		uint32_t		stepsCount = m_executionSteps.size();
+		uint32_t		certainStep;
+		uint32_t		low;
+		uint32_t		high;
+		uint32_t		middle;
+		double			threshold;
+
+
+		if (fromStep >= stepsCount)
+		{
+			return stepsCount;
+		}
+
+		// steps before the certain step - selected at the first step with cumulated
+		// non selection (relative to fromStep) below the drawn value
+		certainStep = m_nextCertainStep[fromStep];
+		threshold = (1 - uniform) * m_skipProduct[fromStep];
+		low = fromStep;
+		high = certainStep;
+
+		while (low < high)
+		{
+			middle = low + (high - low) / 2;
+
+			if (m_skipProduct[middle + 1] < threshold)
+			{
+				high = middle;
+			}
+			else
+			{
+				low = middle + 1;
+			}
+		}
+
+		// low is either the selected step, the certain step or steps count
+		return low;
+	}
+
+	void SetGroupJoin (uint32_t parallelGroup, JoinPolicy policy, uint32_t k)
+	{
+		NS_ASSERT(parallelGroup != 0);
+		NS_ASSERT(policy != JoinKOfN || k > 0);
+
+		GroupJoin		join;
+
+
+		join.policy = policy;
+		join.k = k;
+
+		m_groupJoins[parallelGroup] = join;
+	}
+
+	// percentile from (0, 100) - 0 if the delay is fixed
+	void SetStepHedging (uint32_t stepIndex, Time delay, double percentile)
+	{
+		NS_ASSERT(!m_isFinalized);
+		NS_ASSERT(stepIndex < m_executionSteps.size());
+		NS_ASSERT(percentile >= 0 && percentile < 100);
+		NS_ASSERT(delay > Seconds(0) || percentile > 0);
+
+		StepHedging		hedging;
+
+
+		hedging.delay = delay;
+		hedging.percentile = percentile;
+
+		m_hedgings[stepIndex] = hedging;
+	}
+
+	// groups without configured join wait for all calls
+	GroupJoin GetGroupJoin (uint32_t parallelGroup) const
+	{
+		map<uint32_t, GroupJoin>::const_iterator		it = m_groupJoins.find(parallelGroup);
+		GroupJoin										join;
+
+
+		if (it != m_groupJoins.end())
+		{
+			return it->second;
+		}
+
+		join.policy = JoinAll;
+		join.k = 0;
+
+		return join;
+	}
+
 }; // ExecutionPlan
 
 
@@ -549,20 +863,41 @@ public:
 
 	virtual ~ServiceExecutionPlan() {}
 
-	const RandomVariable GetPlanPreExeDelay() const { return m_planPreExeDelay; }
-	const RandomVariable GetPlanPostExeDelay() const { return m_planPostExeDelay; }
-	const RandomVariable GetStepPostExeDelay() const { return m_stepPostExeDelay; }
-	const RandomVariable GetPostPlanErrorDelay() const { return m_postPlanErrorDelay; }
+	const RandomVariable & GetPlanPreExeDelay() const { return m_planPreExeDelay; }
+	const RandomVariable & GetPlanPostExeDelay() const { return m_planPostExeDelay; }
+	const RandomVariable & GetStepPostExeDelay() const { return m_stepPostExeDelay; }
+	const RandomVariable & GetPostPlanErrorDelay() const { return m_postPlanErrorDelay; }
 
 }; // ServiceExecutionPlan
 
 
 
+/*
+ * Arrival process of the client
+ * 		ArrivalClosedLoop - (default) the next request waits for the response and the request rate delay
+ * 		ArrivalPoisson, ArrivalDeterministic - open loop, requests arrive with exponential or constant
+ * 			interarrival times regardless of responses
+ * 		ArrivalTrace - open loop, requests arrive at offsets (from the client start) of the trace
+ * 		Each open loop arrival is an independent conversation.
+ */
 class ClientExecutionPlan : public ExecutionPlan
 {
+public:
+	enum ArrivalProcess
+	{
+		ArrivalClosedLoop,
+		ArrivalPoisson,
+		ArrivalDeterministic,
+		ArrivalTrace
+	};
+
 private:
 	const RandomVariable 				m_requestRate;
 	const RandomVariable				m_afterFailureWaitingPeriod;
+	ArrivalProcess						m_arrivalProcess;
+	// interarrival time (ms) of poisson and deterministic arrivals
+	RandomVariable						m_arrivalInterval;
+	vector<Time>						m_arrivalTrace;
 
 public:
 
@@ -570,13 +905,51 @@ public:
 			RandomVariable requestRate,
 			RandomVariable afterFailureWaitingPeriod)
 		:m_requestRate (requestRate),
-		 m_afterFailureWaitingPeriod (afterFailureWaitingPeriod)
+		 m_afterFailureWaitingPeriod (afterFailureWaitingPeriod),
+		 m_arrivalProcess (ArrivalClosedLoop)
 	{}
 
 	virtual ~ClientExecutionPlan() {}
 
-	const RandomVariable GetRequestRate() const { return m_requestRate; }
-	const RandomVariable GetAfterFailureWaitingPeriod() const { return m_afterFailureWaitingPeriod; }
+	const RandomVariable & GetRequestRate() const { return m_requestRate; }
+	const RandomVariable & GetAfterFailureWaitingPeriod() const { return m_afterFailureWaitingPeriod; }
+	ArrivalProcess GetArrivalProcess() const { return m_arrivalProcess; }
+	const RandomVariable & GetArrivalInterval() const { return m_arrivalInterval; }
+	const vector<Time> & GetArrivalTrace() const { return m_arrivalTrace; }
+
+	void SetOpenLoopArrivals (ArrivalProcess arrivalProcess, double arrivalsPerSecond)
+	{
+		NS_ASSERT(arrivalProcess == ArrivalPoisson || arrivalProcess == ArrivalDeterministic);
+		NS_ASSERT(arrivalsPerSecond > 0);
+
+		double		meanInterval = 1000.0 / arrivalsPerSecond;
+
+
+		m_arrivalProcess = arrivalProcess;
+
+		if (arrivalProcess == ArrivalPoisson)
+		{
+			m_arrivalInterval = ExponentialVariable(meanInterval);
+		}
+		else
+		{
+			m_arrivalInterval = ConstantVariable(meanInterval);
+		}
+	}
+
+	// arrivals - offsets from the client start in ascending order
+	void SetArrivalTrace (const vector<Time> & arrivals)
+	{
+		NS_ASSERT(!arrivals.empty());
+
+		for (uint32_t i = 1; i < arrivals.size(); i++)
+		{
+			NS_ASSERT(arrivals[i - 1] <= arrivals[i]);
+		}
+
+		m_arrivalProcess = ArrivalTrace;
+		m_arrivalTrace = arrivals;
+	}
 
 }; // ClientExecutionPlan
 
@@ -670,6 +1043,143 @@ public:
 }; // Client
 
 
+/*
+ * Response cache of a service method
+ * 		Responses are cached by key, the key of a request is given by the keying policy:
+ * 			KeyMethod - all requests of the method share one response
+ * 			KeyCaller - requests of the same calling service/client share a response
+ * 			KeySynthetic - key drawn from the given distribution for each request (key popularity)
+ * 		Entries expire after the ttl, the least recently used entry is evicted above the capacity.
+ * 		Each replica of the method has its own cache.
+ */
+class ResponseCache : public Object
+{
+public:
+
+	enum KeyPolicy
+	{
+		KeyMethod,
+		KeyCaller,
+		KeySynthetic
+	};
+
+private:
+
+	struct CacheEntry
+	{
+		uint32_t		key;
+		Time			expiry;
+	};
+
+	const uint32_t									m_capacity;
+	const Time										m_ttl;
+	const KeyPolicy									m_keyPolicy;
+	const RandomVariable							m_syntheticKeys;
+	// most recently used first
+	list<CacheEntry>								m_entries;
+	map<uint32_t, list<CacheEntry>::iterator>		m_index;
+
+	static uint32_t									s_numberOfHits;
+	static uint32_t									s_numberOfMisses;
+
+public:
+
+	ResponseCache (
+			uint32_t capacity,
+			Time ttl,
+			KeyPolicy keyPolicy,
+			RandomVariable syntheticKeys)
+		:m_capacity (capacity),
+		 m_ttl (ttl),
+		 m_keyPolicy (keyPolicy),
+		 m_syntheticKeys (syntheticKeys)
+	{
+		NS_ASSERT(capacity > 0);
+	}
+
+	virtual ~ResponseCache() {}
+
+	// empty cache with the same configuration
+	Ptr<ResponseCache> CreateReplica ()
+	{
+		return CreateObject<ResponseCache>(
+				m_capacity,
+				m_ttl,
+				m_keyPolicy,
+				m_syntheticKeys);
+	}
+
+	uint32_t GetSize () const { return m_entries.size(); }
+
+	uint32_t DrawKey (uint32_t callerId) const
+	{
+		switch (m_keyPolicy)
+		{
+			case KeyCaller: return callerId;
+			case KeySynthetic: return m_syntheticKeys.GetInteger();
+			default: return 0;
+		}
+	}
+
+	bool Lookup (uint32_t key)
+	{
+		map<uint32_t, list<CacheEntry>::iterator>::iterator		it = m_index.find(key);
+
+
+		if (it != m_index.end() && it->second->expiry <= Simulator::Now())
+		{
+			m_entries.erase(it->second);
+			m_index.erase(it);
+			it = m_index.end();
+		}
+
+		if (it == m_index.end())
+		{
+			s_numberOfMisses++;
+			return false;
+		}
+
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		s_numberOfHits++;
+
+		return true;
+	}
+
+	void Insert (uint32_t key)
+	{
+		map<uint32_t, list<CacheEntry>::iterator>::iterator		it = m_index.find(key);
+		CacheEntry												entry;
+
+
+		if (it != m_index.end())
+		{
+			it->second->expiry = Simulator::Now() + m_ttl;
+			m_entries.splice(m_entries.begin(), m_entries, it->second);
+			return;
+		}
+
+		entry.key = key;
+		entry.expiry = Simulator::Now() + m_ttl;
+
+		m_entries.push_front(entry);
+		m_index.insert(make_pair(key, m_entries.begin()));
+
+		if (m_entries.size() > m_capacity)
+		{
+			m_index.erase(m_entries.back().key);
+			m_entries.pop_back();
+		}
+	}
+
+	static uint32_t GetNumberOfHits () { return s_numberOfHits; }
+	static uint32_t GetNumberOfMisses () { return s_numberOfMisses; }
+
+}; // ResponseCache
+
+uint32_t		ResponseCache::s_numberOfHits = 0;
+uint32_t		ResponseCache::s_numberOfMisses = 0;
+
+
 class Service;
 
 class ServiceMethod : public Object
@@ -680,6 +1190,8 @@ private:
 	const RandomVariable					m_responseSize;
 	Ptr<FaultModel> 						m_faultModel;
 	const Ptr<ServiceExecutionPlan>			m_executionPlan;
+	// null if responses are not cached
+	Ptr<ResponseCache>						m_responseCache;
 
 public:
 
@@ -706,12 +1218,20 @@ public:
 	Ptr<ServiceMethod> CreateReplica(
 			Ptr<Service> newService)
 	{
-		return CreateObject<ServiceMethod>(
+		Ptr<ServiceMethod>	method = CreateObject<ServiceMethod>(
 			m_contractMethodId,
 			newService,
 			m_responseSize,
 			m_faultModel,
 			m_executionPlan); // plan remains the same - same configuraiton of steps and dependencies
+
+
+		if (m_responseCache != NULL)
+		{
+			method->SetResponseCache(m_responseCache->CreateReplica());
+		}
+
+		return method;
 	}
 
 	const uint32_t GetContractMethodId () const { return m_contractMethodId; }
@@ -719,6 +1239,7 @@ public:
 	const RandomVariable GetResponseSize () const { return m_responseSize; }
 	const Ptr<FaultModel> GetFaultModel () const { return m_faultModel; }
 	const Ptr<ServiceExecutionPlan> GetExecutionPlan () const { return m_executionPlan; }
+	const Ptr<ResponseCache> GetResponseCache () const { return m_responseCache; }
 
 	void SetFaultModel (Ptr<FaultModel> faultModel)
 	{
@@ -726,17 +1247,35 @@ public:
 		m_faultModel = faultModel->Clone();
 	}
 
+	void SetResponseCache (Ptr<ResponseCache> responseCache)
+	{
+		m_responseCache = responseCache;
+	}
+
 
 }; // ServiceMethod
 
 
 class Service : public ServiceBase
 {
+public:
+
+	// key of token buckets of rate limiting - the calling service/client or the client of the conversation
+	enum RateLimitKey
+	{
+		RateLimitBySourceService,
+		RateLimitByOriginClient
+	};
+
 private:
 	const uint32_t 								m_contractId;
 	Ptr<FaultModel> 							m_faultModel;
 	map<uint32_t, Ptr<ServiceMethod> >			m_methods;
 	const RandomVariable						m_postErrorDelay;
+	// requests per second of each client - 0 if not limited
+	double										m_rateLimit;
+	double										m_rateBurst;
+	RateLimitKey								m_rateLimitKey;
 
 public:
 
@@ -760,7 +1299,10 @@ public:
 				msgIdLifetime),
 		m_contractId (contractId),
 		m_faultModel (faultModel->Clone()),
-		m_postErrorDelay (postErrorDelay)
+		m_postErrorDelay (postErrorDelay),
+		m_rateLimit (0),
+		m_rateBurst (0),
+		m_rateLimitKey (RateLimitBySourceService)
 	{
 		NS_ASSERT(contractId != 0);
 		NS_ASSERT(faultModel != NULL);
@@ -787,6 +1329,9 @@ public:
 				m_faultModel,
 				m_postErrorDelay);
 
+		service->m_rateLimit = m_rateLimit;
+		service->m_rateBurst = m_rateBurst;
+		service->m_rateLimitKey = m_rateLimitKey;
 
 		for (it = m_methods.begin(); it != m_methods.end(); it++)
 		{
@@ -806,6 +1351,20 @@ public:
 	const map<uint32_t, Ptr<ServiceMethod> > GetMethods () const { return m_methods; }
 	const Ptr<ServiceMethod> GetMethod (uint32_t methodContractId) const { return m_methods.find(methodContractId)->second; }
 	const RandomVariable GetPostErrorDelay () const { return m_postErrorDelay; }
+	double GetRateLimit () const { return m_rateLimit; }
+	double GetRateBurst () const { return m_rateBurst; }
+	RateLimitKey GetRateLimitKey () const { return m_rateLimitKey; }
+
+	// token bucket of each client - refilled by rate (requests per second) up to burst requests
+	void SetClientRateLimit (double rate, double burst, RateLimitKey key)
+	{
+		NS_ASSERT(rate > 0);
+		NS_ASSERT(burst >= 1);
+
+		m_rateLimit = rate;
+		m_rateBurst = burst;
+		m_rateLimitKey = key;
+	}
 
 	Ptr<ServiceMethod> AddMethod (
 		uint32_t contractMethodId,
@@ -868,10 +1427,13 @@ class ServiceConfiguration : public Object
 {
 private:
 	map<uint32_t, Ptr<Service> >			m_services;
-	map<uint32_t, Ptr<Service> >			m_contracts;
+	// key is contractId, value is services implementing the contract (replicas)
+	map<uint32_t, vector<Ptr<Service> > >	m_contracts;
 	map<uint32_t, Ptr<Client> >				m_clients;
 	bool 									m_deployClientsRandomly;
 
+	static const vector<Ptr<Service> >		s_noServices;
+
 public:
 
 	ServiceConfiguration ()
@@ -882,11 +1444,26 @@ public:
 	virtual ~ServiceConfiguration() {}
 
 	Ptr<Service> GetService (uint32_t serviceId) const { return m_services.find(serviceId)->second; }
-	Ptr<Service> GetContract (uint32_t contractId) const { return m_contracts.find(contractId)->second; }
 	Ptr<Client> GetClient (uint32_t clientId) const { return m_clients.find(clientId)->second; }
 	const map<uint32_t, Ptr<Service> > & GetServices () const { return m_services; }
+	const map<uint32_t, vector<Ptr<Service> > > & GetContracts () const { return m_contracts; }
 	const map<uint32_t, Ptr<Client> > & GetClients () const { return m_clients; }
 	const bool GetDeployClientsRandomly () const { return m_deployClientsRandomly; }
+
+	// services implementing the contract - empty if there is none
+	const vector<Ptr<Service> > & GetContractServices (uint32_t contractId) const
+	{
+		map<uint32_t, vector<Ptr<Service> > >::const_iterator		it = m_contracts.find(contractId);
+
+
+		if (it == m_contracts.end())
+		{
+			return s_noServices;
+		}
+
+		return it->second;
+	}
+
 	void SetDeployClientsRandomly (bool value) { m_deployClientsRandomly=value; }
 
 	void AddService(
@@ -921,7 +1498,7 @@ public:
 				postErrorDelay);
 
 		m_services.insert( pair<uint32_t, Ptr<Service> > (serviceId, service));
-		m_contracts.insert( pair<uint32_t, Ptr<Service> > (contractId, service));
+		m_contracts[contractId].push_back(service);
 	}
 
 	void AddServiceReplica(
@@ -939,7 +1516,7 @@ public:
 		newService = service->CreateReplica(newServiceId);
 
 		m_services.insert( pair<uint32_t, Ptr<Service> > (newServiceId, newService));
-		m_contracts.insert( pair<uint32_t, Ptr<Service> > (newService->GetContractId(), newService));
+		m_contracts[newService->GetContractId()].push_back(newService);
 	}
 
 	Ptr<ServiceMethod> AddServiceMethod (
@@ -979,7 +1556,8 @@ public:
 			uint32_t destContractId,
 			uint32_t destContractMethodId,
 			RandomVariable requestSize,
-			double stepProbability)
+			double stepProbability,
+			uint32_t parallelGroup = 0)
 	{
 		NS_ASSERT(serviceId != 0);
 		NS_ASSERT(contractMethodId != 0);
@@ -1000,24 +1578,100 @@ public:
 				destContractId,
 				destContractMethodId,
 				requestSize,
-				stepProbability);
+				stepProbability,
+				parallelGroup);
 	}
 
-	void AddClient(
-			uint32_t clientId,
-			Time startTime,
-			Time stopTime,
-			Time responseTimeout,
-			Time ACKTimeout,
-			uint32_t retransmissionLimit,
-			Time msgIdLifetime,
-			RandomVariable planRequestRate,
-			RandomVariable afterFailureWaitingPeriod)
+	// join policy of a parallel step group of the method - k used only for JoinKOfN
+	void SetServiceExecutionGroupJoin (
+			uint32_t serviceId,
+			uint32_t contractMethodId,
+			uint32_t parallelGroup,
+			ExecutionPlan::JoinPolicy policy,
+			uint32_t k)
 	{
-		NS_ASSERT(clientId != 0);
+		NS_ASSERT(serviceId != 0);
+		NS_ASSERT(contractMethodId != 0);
 
-		Ptr<ExecutionPlan> 	plan = CreateObject<ClientExecutionPlan>(
-				planRequestRate,
+		Ptr<Service> service = GetService(serviceId);
+		Ptr<ServiceMethod> method = service->GetMethod(contractMethodId);
+
+
+		NS_ASSERT(method != NULL);
+
+		method->GetExecutionPlan()->SetGroupJoin(parallelGroup, policy, k);
+	}
+
+	// cache of responses of the method - syntheticKeys used only for KeySynthetic, replicas created
+	// afterwards have their own caches
+	void SetServiceMethodResponseCache (
+			uint32_t serviceId,
+			uint32_t contractMethodId,
+			uint32_t capacity,
+			Time ttl,
+			ResponseCache::KeyPolicy keyPolicy,
+			RandomVariable syntheticKeys = ConstantVariable(0))
+	{
+		NS_ASSERT(serviceId != 0);
+		NS_ASSERT(contractMethodId != 0);
+
+		Ptr<Service> service = GetService(serviceId);
+		Ptr<ServiceMethod> method = service->GetMethod(contractMethodId);
+
+
+		NS_ASSERT(method != NULL);
+
+		method->SetResponseCache(CreateObject<ResponseCache>(capacity, ttl, keyPolicy, syntheticKeys));
+	}
+
+	// token bucket rate limiting of each client of the service - rate in requests per second,
+	// replicas created afterwards share the configuration
+	void SetServiceClientRateLimit (
+			uint32_t serviceId,
+			double rate,
+			double burst,
+			Service::RateLimitKey key)
+	{
+		NS_ASSERT(serviceId != 0);
+
+		GetService(serviceId)->SetClientRateLimit(rate, burst, key);
+	}
+
+	// hedging of a step of the method - stepIndex is the index in the order the steps were added
+	void SetServiceExecutionStepHedging (
+			uint32_t serviceId,
+			uint32_t contractMethodId,
+			uint32_t stepIndex,
+			Time delay,
+			double percentile)
+	{
+		NS_ASSERT(serviceId != 0);
+		NS_ASSERT(contractMethodId != 0);
+
+		Ptr<Service> service = GetService(serviceId);
+		Ptr<ServiceMethod> method = service->GetMethod(contractMethodId);
+
+
+		NS_ASSERT(method != NULL);
+
+		method->GetExecutionPlan()->SetStepHedging(stepIndex, delay, percentile);
+	}
+
+	void AddClient(
+			uint32_t clientId,
+			Time startTime,
+			Time stopTime,
+			Time responseTimeout,
+			Time ACKTimeout,
+			uint32_t retransmissionLimit,
+			Time msgIdLifetime,
+			RandomVariable planRequestRate,
+			RandomVariable afterFailureWaitingPeriod)
+	{
+		NS_ASSERT(clientId != 0);
+
+		Ptr<ExecutionPlan> 	plan = CreateObject<ClientExecutionPlan>(
+				planRequestRate,
 				afterFailureWaitingPeriod);
 
 		Ptr<Client> 				client = new Client (
@@ -1056,6 +1710,58 @@ public:
 				stepProbability);
 	}
 
+	void SetClientExecutionStepHedging (
+			uint32_t clientId,
+			uint32_t stepIndex,
+			Time delay,
+			double percentile)
+	{
+		NS_ASSERT(clientId != 0);
+
+		GetClient(clientId)->GetExecutionPlan()->SetStepHedging(stepIndex, delay, percentile);
+	}
+
+	// open loop arrivals of the client - poisson or deterministic
+	void SetClientOpenLoopArrivals (
+			uint32_t clientId,
+			ClientExecutionPlan::ArrivalProcess arrivalProcess,
+			double arrivalsPerSecond)
+	{
+		NS_ASSERT(clientId != 0);
+
+		Ptr<ClientExecutionPlan>	plan = DynamicCast<ClientExecutionPlan>(GetClient(clientId)->GetExecutionPlan());
+
+
+		NS_ASSERT(plan != NULL);
+
+		plan->SetOpenLoopArrivals(arrivalProcess, arrivalsPerSecond);
+	}
+
+	// trace driven open loop arrivals of the client - file with one arrival offset (ms) per line
+	void LoadClientArrivalTrace (
+			uint32_t clientId,
+			const char* traceFileName)
+	{
+		NS_ASSERT(clientId != 0);
+		NS_ASSERT(traceFileName != NULL);
+
+		Ptr<ClientExecutionPlan>	plan = DynamicCast<ClientExecutionPlan>(GetClient(clientId)->GetExecutionPlan());
+		ifstream					traceStream(traceFileName);
+		vector<Time>				arrivals;
+		double						offset;
+
+
+		NS_ASSERT(plan != NULL);
+		NS_ASSERT(traceStream.is_open());
+
+		while (traceStream >> offset)
+		{
+			arrivals.push_back(NanoSeconds((uint64_t)(offset * 1000000)));
+		}
+
+		plan->SetArrivalTrace(arrivals);
+	}
+
 	/* Checks ServiceConfiguration for following inconsistencies
 	 * Service
 	 * - at least one service in ServiceConfiguration
@@ -1079,19 +1785,46 @@ public:
 		return bPass;
 	}
 
+	// selection tables of all plans - after the configuration is complete
+	void FinalizeExecutionPlans ()
+	{
+		map<uint32_t, Ptr<Client> >::iterator				cit;
+		map<uint32_t, Ptr<Service> >::iterator				sit;
+		map<uint32_t, Ptr<ServiceMethod> >					serviceMethods;
+		map<uint32_t, Ptr<ServiceMethod> >::const_iterator	mit;
+
+
+		for (cit = m_clients.begin(); cit != m_clients.end(); cit++)
+		{
+			cit->second->GetExecutionPlan()->Finalize();
+		}
+
+		for (sit = m_services.begin(); sit != m_services.end(); sit++)
+		{
+			serviceMethods = sit->second->GetMethods();
+
+			for (mit = serviceMethods.begin(); mit != serviceMethods.end(); mit++)
+			{
+				mit->second->GetExecutionPlan()->Finalize();
+			}
+		}
+	}
+
 	void WriteOutStatistics () const
 	{
 		int 		numberOfClientExecutionSteps = 0;
 		int			numberOfServiceMethods = 0;
 		int			numberOfServiceExecutionSteps = 0;
 		int			numberOfOrphanServices = 0;
+		int			numberOfReplicatedContracts = 0;
 
 		map<uint32_t, Ptr<Service> >::const_iterator		sit;
 		Ptr<Service>										service;
 		map<uint32_t, Ptr<ServiceMethod> >					serviceMethods;
 		map<uint32_t, Ptr<ServiceMethod> >::const_iterator 	smit;
 		Ptr<ServiceMethod>									serviceMethod;
-		map<uint32_t, Ptr<Service> >						contractsCopy(m_contracts);
+		map<uint32_t, vector<Ptr<Service> > >				contractsCopy(m_contracts);
+		map<uint32_t, vector<Ptr<Service> > >::const_iterator	ctit;
 		map<uint32_t, Ptr<Client> >::const_iterator			cit;
 		Ptr<Client>											client;
 		Ptr<ExecutionPlan>									plan;
@@ -1123,12 +1856,26 @@ public:
 			RemoveExecutionPlanContractsFromVector(plan, contractsCopy);
 		}
 
-		numberOfOrphanServices = contractsCopy.size();
+		// services of contracts not used by any execution step
+		for (ctit = contractsCopy.begin(); ctit != contractsCopy.end(); ctit++)
+		{
+			numberOfOrphanServices += ctit->second.size();
+		}
+
+		for (ctit = m_contracts.begin(); ctit != m_contracts.end(); ctit++)
+		{
+			if (ctit->second.size() > 1)
+			{
+				numberOfReplicatedContracts++;
+			}
+		}
 
 		NS_LOG_UNCOND("Service configuration statistics ...");
 		NS_LOG_UNCOND("	Number of clients: " << m_clients.size());
 		NS_LOG_UNCOND("	Number of clients' execution steps: " << numberOfClientExecutionSteps);
 		NS_LOG_UNCOND("	Number of services: " << m_services.size());
+		NS_LOG_UNCOND("	Number of contracts: " << m_contracts.size());
+		NS_LOG_UNCOND("	Number of replicated contracts: " << numberOfReplicatedContracts);
 		NS_LOG_UNCOND("	Number of services' methods: " << numberOfServiceMethods);
 		NS_LOG_UNCOND("	Number of services' execution steps: " << numberOfServiceExecutionSteps);
 		NS_LOG_UNCOND("	Number of orphan services: " << numberOfOrphanServices);
@@ -1293,7 +2040,7 @@ private:
 
 	void RemoveExecutionPlanContractsFromVector (
 			const Ptr<ExecutionPlan> plan,
-			map<uint32_t, Ptr<Service> > & contractsCopy) const
+			map<uint32_t, vector<Ptr<Service> > > & contractsCopy) const
 	{
 		NS_ASSERT(plan != NULL);
 
@@ -1426,25 +2173,31 @@ private:
 		NS_ASSERT(plan != NULL);
 
 		vector<Ptr<ExecutionStep> >::const_iterator		it;
+		vector<Ptr<Service> >::const_iterator			sit;
 		Ptr<ExecutionStep>								step;
-		Ptr<Service>									contract;
 
 
 		for (it = plan->GetExecutionSteps().begin(); it != plan->GetExecutionSteps().end(); it++)
 		{
 			step = *it;
-			contract = GetContract(step->GetContractId());
+			const vector<Ptr<Service> > &		contractServices = GetContractServices(step->GetContractId());
+
 
-			if (contract == 0)
+			if (contractServices.size() == 0)
 			{
 				NS_LOG_UNCOND("	error: execution step to non existing contract id: " << step->GetContractId());
 				return false;
 			}
 
-			if (contract->GetMethod(step->GetContractMethodId()) == 0)
+			// any replica may be selected - all of them have to implement the method
+			for (sit = contractServices.begin(); sit != contractServices.end(); sit++)
 			{
-				NS_LOG_UNCOND("	error: execution step to non existing method id: " << step->GetContractMethodId());
-				return false;
+				if ((*sit)->GetMethod(step->GetContractMethodId()) == 0)
+				{
+					NS_LOG_UNCOND("	error: execution step to non existing method id: " << step->GetContractMethodId());
+					NS_LOG_UNCOND("	contract service: " << (*sit)->GetServiceId());
+					return false;
+				}
 			}
 		}
 
@@ -1453,6 +2206,8 @@ private:
 
 }; // ServiceConfiguration
 
+const vector<Ptr<Service> >		ServiceConfiguration::s_noServices;
+
 
 
 
@@ -1486,6 +2241,8 @@ class Message : public Header, public Object, public InstanceCounter
 private:
 	static uint32_t s_messageCounter;
 	static uint32_t s_conversationCounter;
+	static bool s_isDeadlinePropagated;
+	static bool s_isOriginPropagated;
 
 	uint32_t m_messageType;
 	uint32_t m_messageId;
@@ -1497,6 +2254,11 @@ private:
 	uint32_t m_destService;
 	uint32_t m_destMethod;
 	uint32_t m_size;
+	// client (or service) which started the conversation
+	uint32_t m_originService;
+	// absolute time (ns) till the conversation is awaited by its client - 0 if none
+	// (simulation clock is shared, absolute time equals the remaining time at any hop)
+	uint64_t m_deadline;
 
 public:
 
@@ -1524,7 +2286,9 @@ public:
 		m_destNode (0),
 		m_destService (0),
 		m_destMethod (0),
-		m_size (0)
+		m_size (0),
+		m_originService (0),
+		m_deadline (0)
 	{
 
 	}
@@ -1537,7 +2301,8 @@ public:
 			uint32_t destNode,
 			uint32_t destService,
 			uint32_t destMethod,
-			uint32_t size)
+			uint32_t size,
+			Time deadline)
 	{
 		m_messageType = MTRequest;
 		m_messageId = ++s_messageCounter;
@@ -1549,6 +2314,8 @@ public:
 		m_destService = destService;
 		m_destMethod = destMethod;
 		m_size = size;
+		m_originService = srcService;
+		m_deadline = s_isDeadlinePropagated ? deadline.GetNanoSeconds() : 0;
 	}
 
 	void InitializeResponse (Ptr<Message> sourceMsg, uint32_t size)
@@ -1565,6 +2332,8 @@ public:
 		m_destService = sourceMsg->m_destService;
 		m_destMethod = sourceMsg->m_destMethod;
 		m_size = size;
+		m_originService = sourceMsg->m_originService;
+		m_deadline = sourceMsg->m_deadline;
 	}
 
 	void InitializeACK (Ptr<Message> sourceMsg)
@@ -1581,6 +2350,8 @@ public:
 		m_destService = sourceMsg->m_destService;
 		m_destMethod = sourceMsg->m_destMethod;
 		m_size = ACK_MESSAGE_SIZE;
+		m_originService = sourceMsg->m_originService;
+		m_deadline = sourceMsg->m_deadline;
 	}
 
 	void InitializeResponseException (Ptr<Message> sourceMsg)
@@ -1597,6 +2368,8 @@ public:
 		m_destService = sourceMsg->m_destService;
 		m_destMethod = sourceMsg->m_destMethod;
 		m_size = RESPONSE_EXCEPTION_MESSAGE_SIZE;
+		m_originService = sourceMsg->m_originService;
+		m_deadline = sourceMsg->m_deadline;
 	}
 
 	void InitializeNext (Ptr<Message> sourceMsg, uint32_t destNode, uint32_t destService, uint32_t destMethod, uint32_t size)
@@ -1613,8 +2386,20 @@ public:
 		m_destService = destService;
 		m_destMethod = destMethod;
 		m_size = size;
+		m_originService = sourceMsg->m_originService;
+		m_deadline = sourceMsg->m_deadline;
 	}
 
+	// new conversations get deadlines - applies to conversations started afterwards
+	static void EnableDeadlinePropagation () { s_isDeadlinePropagated = true; }
+	static bool IsDeadlinePropagated () { return s_isDeadlinePropagated; }
+	// the originating client is carried to services - enabled before messages are sent
+	static void EnableOriginPropagation () { s_isOriginPropagated = true; }
+
+	bool HasDeadline () const { return m_deadline != 0; }
+	Time GetDeadline () const { return NanoSeconds(m_deadline); }
+	bool IsDeadlineExpired () const { return m_deadline != 0 && (uint64_t)Simulator::Now().GetNanoSeconds() >= m_deadline; }
+
 	uint32_t GetMessageType() const { return m_messageType; }
 	uint32_t GetMessageId () const { return m_messageId; }
 	uint32_t GetRelatedToMessageId () const { return m_relatedToMessageId; }
@@ -1625,10 +2410,12 @@ public:
 	uint32_t GetDestService () const { return m_destService; }
 	uint32_t GetDestMethod () const { return m_destMethod; }
 	uint32_t GetSize () const { return m_size; }
+	uint32_t GetOriginService () const { return m_originService; }
 
 
 	virtual TypeId GetInstanceTypeId (void) const { return GetTypeId (); }
-	virtual uint32_t GetSerializedSize (void) const { return 40; }
+	// deadline and origin are carried only if propagated - headers of scenarios without them are not enlarged
+	virtual uint32_t GetSerializedSize (void) const { return 40 + (s_isOriginPropagated ? 4 : 0) + (s_isDeadlinePropagated ? 8 : 0); }
 	virtual void Print (std::ostream &os) const {}
 
 	/*
@@ -1680,6 +2467,16 @@ public:
 		start.WriteU32 (m_destService);
 		start.WriteU32 (m_destMethod);
 		start.WriteU32 (m_size);
+
+		if (s_isOriginPropagated)
+		{
+			start.WriteU32 (m_originService);
+		}
+
+		if (s_isDeadlinePropagated)
+		{
+			start.WriteU64 (m_deadline);
+		}
 	}
 
 	virtual uint32_t Deserialize (Buffer::Iterator start)
@@ -1694,7 +2491,18 @@ public:
 		m_destService = start.ReadU32 ();
 		m_destMethod = start.ReadU32 ();
 		m_size = start.ReadU32();
-		return 40;
+
+		if (s_isOriginPropagated)
+		{
+			m_originService = start.ReadU32();
+		}
+
+		if (s_isDeadlinePropagated)
+		{
+			m_deadline = start.ReadU64();
+		}
+
+		return GetSerializedSize();
 	}
 
 	static uint32_t GetMessageCounter () { return s_messageCounter; }
@@ -1704,6 +2512,8 @@ public:
 
 uint32_t Message::s_messageCounter = 0;
 uint32_t Message::s_conversationCounter = 0;
+bool Message::s_isDeadlinePropagated = false;
+bool Message::s_isOriginPropagated = false;
 
 
 
@@ -1718,6 +2528,10 @@ uint32_t Message::s_conversationCounter = 0;
 #define ERROR_TYPE_SEND_FAILURE			"SEND_FAILURE"
 #define ERROR_TYPE_SERVICE_NOT_FOUND	"SERVICE_NOT_FOUND"
 #define ERROR_TYPE_SOCKET_FAILURE		"SOCKET_FAILURE"
+#define ERROR_TYPE_GROUP_JOIN_FAILURE	"GROUP_JOIN_FAILURE"
+#define ERROR_TYPE_DEADLINE_EXPIRED		"DEADLINE_EXPIRED"
+#define ERROR_TYPE_CIRCUIT_OPEN			"CIRCUIT_OPEN"
+#define ERROR_TYPE_RATE_LIMITED			"RATE_LIMITED"
 
 class SimulationOutput : public Object
 {
@@ -1725,6 +2539,15 @@ private:
 	ofstream				m_msgStream;
 	ofstream				m_errStream;
 	ofstream				m_routingTablesStream;
+	ofstream				m_discoveryStream;
+	ofstream				m_scalingStream;
+	ofstream				m_queueStream;
+	ofstream				m_groupStream;
+	ofstream				m_arrivalStream;
+	ofstream				m_breakerStream;
+	ofstream				m_hedgeStream;
+	ofstream				m_cacheStream;
+	ofstream				m_admissionStream;
 
 	static uint32_t			s_errCounter;
 
@@ -1781,6 +2604,15 @@ public:
 		m_msgStream.close();
 		m_errStream.close();
 		m_routingTablesStream.close();
+		m_discoveryStream.close();
+		m_scalingStream.close();
+		m_queueStream.close();
+		m_groupStream.close();
+		m_arrivalStream.close();
+		m_breakerStream.close();
+		m_hedgeStream.close();
+		m_cacheStream.close();
+		m_admissionStream.close();
 	}
 
 	void Flush ()
@@ -1788,6 +2620,36 @@ public:
 		m_msgStream.flush();
 		m_errStream.flush();
 		m_routingTablesStream.flush();
+		m_discoveryStream.flush();
+		m_scalingStream.flush();
+		m_queueStream.flush();
+		m_groupStream.flush();
+		m_arrivalStream.flush();
+		m_breakerStream.flush();
+		m_hedgeStream.flush();
+		m_cacheStream.flush();
+		m_admissionStream.flush();
+	}
+
+	// discovery traffic is traced separately from the service messages - only if discovery is enabled
+	void OpenDiscoveryOutput (const char* discoveryFileName)
+	{
+		NS_ASSERT(discoveryFileName != NULL);
+		NS_ASSERT(!m_discoveryStream.is_open());
+
+		m_discoveryStream.open(discoveryFileName, ios::out);
+
+		m_discoveryStream
+			<< "timestamp,"
+			<< "recordType,"
+			<< "node,"
+			<< "serviceId,"
+			<< "contractId,"
+			<< "originNode,"
+			<< "sequence,"
+			<< "hopsLeft,"
+			<< "size"
+			<< '\r' << '\n';
 	}
 
 	static uint32_t GetErrCounter () { return s_errCounter; }
@@ -1872,109 +2734,484 @@ public:
 				dropedDueToResent);
 	}
 
-	static const char* GetSocketErrnoString (Ptr<Socket> socket)
+	void RecordDiscoveryMessage(
+			char action,
+			uint32_t node,
+			uint32_t serviceId,
+			uint32_t contractId,
+			uint32_t originNode,
+			uint32_t sequence,
+			uint32_t hopsLeft,
+			uint32_t size)
 	{
-		NS_ASSERT(socket != NULL);
-
-		switch(socket->GetErrno())
+		if (!m_discoveryStream.is_open())
 		{
-			case Socket::ERROR_NOTERROR: return "ERROR_NOTERROR";
-			case Socket::ERROR_ISCONN: return "ERROR_ISCONN";
-			case Socket::ERROR_NOTCONN: return "ERROR_NOTCONN";
-			case Socket::ERROR_MSGSIZE: return "ERROR_MSGSIZE";
-			case Socket::ERROR_AGAIN: return "ERROR_AGAIN";
-			case Socket::ERROR_SHUTDOWN: return "ERROR_SHUTDOWN";
-			case Socket::ERROR_OPNOTSUPP: return "ERROR_OPNOTSUPP";
-			case Socket::ERROR_AFNOSUPPORT: return "ERROR_AFNOSUPPORT";
-			case Socket::ERROR_INVAL: return "ERROR_INVAL";
-			case Socket::ERROR_BADF: return "ERROR_BADF";
-			case Socket::ERROR_NOROUTETOHOST: return "ERROR_NOROUTETOHOST";
-			case Socket::SOCKET_ERRNO_LAST: return "SOCKET_ERRNO_LAST";
-			case Socket::ERROR_ADDRNOTAVAIL: return "ERROR_ADDRNOTAVAIL";
-			case Socket::ERROR_NODEV: return "ERROR_NODEV";
-			//case Socket::ERROR_ADDRINUSE: return "ERROR_ADDRINUSE";
+			return;
 		}
 
-		return 0;
+		m_discoveryStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< action << ","
+			<< node << ","
+			<< serviceId << ","
+			<< contractId << ","
+			<< originNode << ","
+			<< sequence << ","
+			<< hopsLeft << ","
+			<< size
+			<< '\r' << '\n';
 	}
 
-	void RecordRoutingTable(Ptr<Node> node)
+	// autoscaler samples - only if autoscaling is enabled
+	void OpenScalingOutput (const char* scalingFileName)
 	{
-		/*
-		// Print  routing table entries for OLSR routing
-        Ptr<RoutingProtocol> routing = node->GetObject<RoutingProtocol>();
-        std::vector<RoutingTableEntry> entry = routing->GetRoutingTableEntries();
+		NS_ASSERT(scalingFileName != NULL);
+		NS_ASSERT(!m_scalingStream.is_open());
 
+		m_scalingStream.open(scalingFileName, ios::out);
 
-//      std::cout << "Routing table for device: " << Names::FindName(node) << std::endl;
-//      m_routingTablesStream << "Routing table for device: " << node->GetId() << std::endl;
+		m_scalingStream
+			<< "timestamp,"
+			<< "contractId,"
+			<< "action,"
+			<< "replicas,"
+			<< "requestRate,"
+			<< "meanResponseTime"
+			<< '\r' << '\n';
+	}
 
-        for (std::vector<RoutingTableEntry,
-        		std::allocator<RoutingTableEntry> >::iterator i=entry.begin();
-        		i!=entry.end(); i++)
-        {
-        	if (i->destAddr != i->nextAddr)
-        		m_routingTablesStream
-        						<< Simulator::Now().GetNanoSeconds() << "- device:"
-        						<< node->GetId() << "\t\t"
-        						<< i->destAddr << "\t\t"
-                                << i->nextAddr << "\t\t"
-                                << i->interface << "\t\t"
-                                << i->distance << std::endl;
-        }
-        */
+	void RecordScalingSample(
+			uint32_t contractId,
+			char action,
+			uint32_t replicas,
+			double requestRate,
+			double meanResponseTime)
+	{
+		if (!m_scalingStream.is_open())
+		{
+			return;
+		}
+
+		m_scalingStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< contractId << ","
+			<< action << ","
+			<< replicas << ","
+			<< requestRate << ","
+			<< meanResponseTime
+			<< '\r' << '\n';
 	}
 
-private:
-	void RecordMessage(
-			char recordType,
+	// worker pools of services - only if worker pools are configured
+	void OpenQueueOutput (const char* queueFileName)
+	{
+		NS_ASSERT(queueFileName != NULL);
+		NS_ASSERT(!m_queueStream.is_open());
+
+		m_queueStream.open(queueFileName, ios::out);
+
+		m_queueStream
+			<< "timestamp,"
+			<< "serviceId,"
+			<< "action,"
+			<< "msgMessageId,"
+			<< "queueLength,"
+			<< "busyWorkers,"
+			<< "workerSlots,"
+			<< "waitTime"
+			<< '\r' << '\n';
+	}
+
+	void RecordQueueEvent(
+			uint32_t serviceId,
+			char action,
 			Ptr<Message> msg,
-			Address addressFrom,
-			Address addressTo,
-			uint32_t retransmission,
-			bool successSent,
-			bool dropedDueToResent)
+			uint32_t queueLength,
+			uint32_t busyWorkers,
+			uint32_t workerSlots,
+			Time waitTime)
 	{
-		NS_ASSERT(recordType != 0);
 		NS_ASSERT(msg != NULL);
 
-		InetSocketAddress from = InetSocketAddress::ConvertFrom(addressFrom);
-		InetSocketAddress to = InetSocketAddress::ConvertFrom(addressTo);
-
+		if (!m_queueStream.is_open())
+		{
+			return;
+		}
 
-		m_msgStream
+		m_queueStream
 			<< Simulator::Now().GetNanoSeconds() << ","
-			<< recordType << ","
-			<< addressFrom << ","
-			<< from.GetIpv4() << ","
-			<< from.GetPort() << ","
-			<< addressTo << ","
-			<< to.GetIpv4() << ","
-			<< to.GetPort() << ","
-			<< msg->GetMessageType() << ","
+			<< serviceId << ","
+			<< action << ","
 			<< msg->GetMessageId() << ","
-			<< msg->GetRelatedToMessageId() << ","
-			<< msg->GetConversationId() << ","
-			<< msg->GetSrcNode() << ","
-			<< msg->GetSrcService() << ","
-			<< msg->GetDestNode() << ","
-			<< msg->GetDestService() << ","
-			<< msg->GetDestMethod() << ","
-			<< msg->GetSize() << ","
-			<< retransmission << ","
-			<< (successSent ? 1 : 0) << ","
-			<< (dropedDueToResent ? 1 : 0)
+			<< queueLength << ","
+			<< busyWorkers << ","
+			<< workerSlots << ","
+			<< waitTime.GetNanoSeconds()
 			<< '\r' << '\n';
-
-		m_msgStream.flush();
 	}
 
-}; // SimulationOutput
+	// joins of parallel step groups - only if group tracing is enabled
+	void OpenGroupOutput (const char* groupFileName)
+	{
+		NS_ASSERT(groupFileName != NULL);
+		NS_ASSERT(!m_groupStream.is_open());
 
-uint32_t SimulationOutput::s_errCounter = 0;
+		m_groupStream.open(groupFileName, ios::out);
 
+		m_groupStream
+			<< "timestamp,"
+			<< "serviceId,"
+			<< "msgConversationId,"
+			<< "parallelGroup,"
+			<< "calls,"
+			<< "succeeded,"
+			<< "failed,"
+			<< "joined,"
+			<< "latency"
+			<< '\r' << '\n';
+	}
 
-class MessageEndpoint : public Object, public InstanceCounter
+	void RecordGroupJoin(
+			uint32_t serviceId,
+			Ptr<Message> conversationMsg,
+			uint32_t parallelGroup,
+			uint32_t calls,
+			uint32_t succeeded,
+			uint32_t failed,
+			bool joined,
+			Time latency)
+	{
+		if (!m_groupStream.is_open())
+		{
+			return;
+		}
+
+		m_groupStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< serviceId << ","
+			<< ((conversationMsg == NULL) ? 0 : conversationMsg->GetConversationId()) << ","
+			<< parallelGroup << ","
+			<< calls << ","
+			<< succeeded << ","
+			<< failed << ","
+			<< joined << ","
+			<< latency.GetNanoSeconds()
+			<< '\r' << '\n';
+	}
+
+	// conversations of open loop clients - only if arrival tracing is enabled
+	void OpenArrivalOutput (const char* arrivalFileName)
+	{
+		NS_ASSERT(arrivalFileName != NULL);
+		NS_ASSERT(!m_arrivalStream.is_open());
+
+		m_arrivalStream.open(arrivalFileName, ios::out);
+
+		m_arrivalStream
+			<< "timestamp,"
+			<< "clientId,"
+			<< "arrivalId,"
+			<< "intendedStartTime,"
+			<< "latency,"
+			<< "success"
+			<< '\r' << '\n';
+	}
+
+	void RecordArrival(
+			uint32_t clientId,
+			uint32_t arrivalId,
+			Time intendedStartTime,
+			Time latency,
+			bool success)
+	{
+		if (!m_arrivalStream.is_open())
+		{
+			return;
+		}
+
+		m_arrivalStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< clientId << ","
+			<< arrivalId << ","
+			<< intendedStartTime.GetNanoSeconds() << ","
+			<< latency.GetNanoSeconds() << ","
+			<< success
+			<< '\r' << '\n';
+	}
+
+	// state transitions of circuit breakers - only if circuit breakers are enabled
+	void OpenBreakerOutput (const char* breakerFileName)
+	{
+		NS_ASSERT(breakerFileName != NULL);
+		NS_ASSERT(!m_breakerStream.is_open());
+
+		m_breakerStream.open(breakerFileName, ios::out);
+
+		m_breakerStream
+			<< "timestamp,"
+			<< "node,"
+			<< "destination,"
+			<< "fromState,"
+			<< "toState,"
+			<< "consecutiveFailures"
+			<< '\r' << '\n';
+	}
+
+	void RecordBreakerTransition(
+			uint32_t nodeId,
+			uint32_t destination,
+			char fromState,
+			char toState,
+			uint32_t consecutiveFailures)
+	{
+		if (!m_breakerStream.is_open())
+		{
+			return;
+		}
+
+		m_breakerStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< nodeId << ","
+			<< destination << ","
+			<< fromState << ","
+			<< toState << ","
+			<< consecutiveFailures
+			<< '\r' << '\n';
+	}
+
+	// hedged steps - only if hedge tracing is enabled
+	void OpenHedgeOutput (const char* hedgeFileName)
+	{
+		NS_ASSERT(hedgeFileName != NULL);
+		NS_ASSERT(!m_hedgeStream.is_open());
+
+		m_hedgeStream.open(hedgeFileName, ios::out);
+
+		m_hedgeStream
+			<< "timestamp,"
+			<< "serviceId,"
+			<< "conversationId,"
+			<< "primaryServiceId,"
+			<< "hedgeServiceId,"
+			<< "hedgeDelay,"
+			<< "hedgeSent,"
+			<< "winner,"
+			<< "latency"
+			<< '\r' << '\n';
+	}
+
+	// winner - 'p' primary request, 'h' hedge request, 'n' none (both failed)
+	void RecordHedgedStep(
+			uint32_t serviceId,
+			Ptr<Message> conversationMsg,
+			uint32_t primaryServiceId,
+			uint32_t hedgeServiceId,
+			Time hedgeDelay,
+			bool hedgeSent,
+			char winner,
+			Time latency)
+	{
+		if (!m_hedgeStream.is_open())
+		{
+			return;
+		}
+
+		m_hedgeStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< serviceId << ","
+			<< ((conversationMsg == NULL) ? 0 : conversationMsg->GetConversationId()) << ","
+			<< primaryServiceId << ","
+			<< hedgeServiceId << ","
+			<< hedgeDelay.GetNanoSeconds() << ","
+			<< hedgeSent << ","
+			<< winner << ","
+			<< latency.GetNanoSeconds()
+			<< '\r' << '\n';
+	}
+
+	// lookups of response caches of methods - only if cache tracing is enabled
+	void OpenCacheOutput (const char* cacheFileName)
+	{
+		NS_ASSERT(cacheFileName != NULL);
+		NS_ASSERT(!m_cacheStream.is_open());
+
+		m_cacheStream.open(cacheFileName, ios::out);
+
+		m_cacheStream
+			<< "timestamp,"
+			<< "serviceId,"
+			<< "methodId,"
+			<< "key,"
+			<< "hit,"
+			<< "cacheSize"
+			<< '\r' << '\n';
+	}
+
+	void RecordCacheLookup(
+			uint32_t serviceId,
+			uint32_t methodId,
+			uint32_t key,
+			bool hit,
+			uint32_t cacheSize)
+	{
+		if (!m_cacheStream.is_open())
+		{
+			return;
+		}
+
+		m_cacheStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< serviceId << ","
+			<< methodId << ","
+			<< key << ","
+			<< hit << ","
+			<< cacheSize
+			<< '\r' << '\n';
+	}
+
+	// admission decisions of service instances - only if admission control is configured
+	void OpenAdmissionOutput (const char* admissionFileName)
+	{
+		NS_ASSERT(admissionFileName != NULL);
+		NS_ASSERT(!m_admissionStream.is_open());
+
+		m_admissionStream.open(admissionFileName, ios::out);
+
+		m_admissionStream
+			<< "timestamp,"
+			<< "serviceId,"
+			<< "admitted,"
+			<< "inFlight,"
+			<< "limit,"
+			<< "queueDelay"
+			<< '\r' << '\n';
+	}
+
+	void RecordAdmission(
+			uint32_t serviceId,
+			bool admitted,
+			uint32_t inFlight,
+			uint32_t limit,
+			Time queueDelay)
+	{
+		if (!m_admissionStream.is_open())
+		{
+			return;
+		}
+
+		m_admissionStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< serviceId << ","
+			<< admitted << ","
+			<< inFlight << ","
+			<< limit << ","
+			<< queueDelay.GetNanoSeconds()
+			<< '\r' << '\n';
+	}
+
+	static const char* GetSocketErrnoString (Ptr<Socket> socket)
+	{
+		NS_ASSERT(socket != NULL);
+
+		switch(socket->GetErrno())
+		{
+			case Socket::ERROR_NOTERROR: return "ERROR_NOTERROR";
+			case Socket::ERROR_ISCONN: return "ERROR_ISCONN";
+			case Socket::ERROR_NOTCONN: return "ERROR_NOTCONN";
+			case Socket::ERROR_MSGSIZE: return "ERROR_MSGSIZE";
+			case Socket::ERROR_AGAIN: return "ERROR_AGAIN";
+			case Socket::ERROR_SHUTDOWN: return "ERROR_SHUTDOWN";
+			case Socket::ERROR_OPNOTSUPP: return "ERROR_OPNOTSUPP";
+			case Socket::ERROR_AFNOSUPPORT: return "ERROR_AFNOSUPPORT";
+			case Socket::ERROR_INVAL: return "ERROR_INVAL";
+			case Socket::ERROR_BADF: return "ERROR_BADF";
+			case Socket::ERROR_NOROUTETOHOST: return "ERROR_NOROUTETOHOST";
+			case Socket::SOCKET_ERRNO_LAST: return "SOCKET_ERRNO_LAST";
+			case Socket::ERROR_ADDRNOTAVAIL: return "ERROR_ADDRNOTAVAIL";
+			case Socket::ERROR_NODEV: return "ERROR_NODEV";
+			//case Socket::ERROR_ADDRINUSE: return "ERROR_ADDRINUSE";
+		}
+
+		return 0;
+	}
+
+	void RecordRoutingTable(Ptr<Node> node)
+	{
+		/*
+		// Print  routing table entries for OLSR routing
+        Ptr<RoutingProtocol> routing = node->GetObject<RoutingProtocol>();
+        std::vector<RoutingTableEntry> entry = routing->GetRoutingTableEntries();
+
+
+//      std::cout << "Routing table for device: " << Names::FindName(node) << std::endl;
+//      m_routingTablesStream << "Routing table for device: " << node->GetId() << std::endl;
+
+        for (std::vector<RoutingTableEntry,
+        		std::allocator<RoutingTableEntry> >::iterator i=entry.begin();
+        		i!=entry.end(); i++)
+        {
+        	if (i->destAddr != i->nextAddr)
+        		m_routingTablesStream
+        						<< Simulator::Now().GetNanoSeconds() << "- device:"
+        						<< node->GetId() << "\t\t"
+        						<< i->destAddr << "\t\t"
+                                << i->nextAddr << "\t\t"
+                                << i->interface << "\t\t"
+                                << i->distance << std::endl;
+        }
+        */
+	}
+
+private:
+	void RecordMessage(
+			char recordType,
+			Ptr<Message> msg,
+			Address addressFrom,
+			Address addressTo,
+			uint32_t retransmission,
+			bool successSent,
+			bool dropedDueToResent)
+	{
+		NS_ASSERT(recordType != 0);
+		NS_ASSERT(msg != NULL);
+
+		InetSocketAddress from = InetSocketAddress::ConvertFrom(addressFrom);
+		InetSocketAddress to = InetSocketAddress::ConvertFrom(addressTo);
+
+
+		m_msgStream
+			<< Simulator::Now().GetNanoSeconds() << ","
+			<< recordType << ","
+			<< addressFrom << ","
+			<< from.GetIpv4() << ","
+			<< from.GetPort() << ","
+			<< addressTo << ","
+			<< to.GetIpv4() << ","
+			<< to.GetPort() << ","
+			<< msg->GetMessageType() << ","
+			<< msg->GetMessageId() << ","
+			<< msg->GetRelatedToMessageId() << ","
+			<< msg->GetConversationId() << ","
+			<< msg->GetSrcNode() << ","
+			<< msg->GetSrcService() << ","
+			<< msg->GetDestNode() << ","
+			<< msg->GetDestService() << ","
+			<< msg->GetDestMethod() << ","
+			<< msg->GetSize() << ","
+			<< retransmission << ","
+			<< (successSent ? 1 : 0) << ","
+			<< (dropedDueToResent ? 1 : 0)
+			<< '\r' << '\n';
+
+		m_msgStream.flush();
+	}
+
+}; // SimulationOutput
+
+uint32_t SimulationOutput::s_errCounter = 0;
+
+
+class MessageEndpoint : public Object, public InstanceCounter
 {
 public:
 
@@ -2173,66 +3410,373 @@ protected:
 }; // ClientMessageEndpoint
 
 
-class ServerMessageEndpoint : public MessageEndpoint
+/*
+ * Per client rate limiting of a service instance
+ * 		Consulted by the server endpoint for each new request before admission control. Every client
+ * 		(the calling service, or the client which started the conversation) has its own token bucket
+ * 		holding at most burst tokens, refilled by rate tokens per second - a request of a client with
+ * 		an empty bucket is over its quota and is answered with exception.
+ */
+class ClientRateLimiter : public Object
 {
 private:
-	Callback<void, Ptr<Message>, Address> 		m_onReceiveRequest;
 
-protected:
-	uint16_t									m_port;
-
-protected:
+	struct TokenBucket
+	{
+		double		tokens;
+		Time		lastRefill;
+	};
 
-	ServerMessageEndpoint (
-			Ptr<Node> node,
-			Ptr<ServiceBase> serviceBase,
-			Ptr<SimulationOutput> simulationOutput,
-			Callback<void, Ptr<Message>, Address> onReceiveRequest,
-			uint16_t port)
-	: MessageEndpoint(node, serviceBase, simulationOutput),
-	  m_onReceiveRequest(onReceiveRequest),
-	  m_port(port)
+	struct ClientCounts
 	{
-		NS_ASSERT (!onReceiveRequest.IsNull());
-		NS_ASSERT (port > 0);
-	}
+		uint32_t	passed;
+		uint32_t	limited;
+	};
+
+	const double								m_rate;
+	const double								m_burst;
+	const Service::RateLimitKey					m_key;
+	// key is the client
+	map<uint32_t, TokenBucket>					m_buckets;
+
+	// key is the client - of all services
+	static map<uint32_t, ClientCounts>			s_clientCounts;
 
 public:
-	virtual ~ServerMessageEndpoint() {}
 
-	InetSocketAddress GetServerSocketAddress ()
+	ClientRateLimiter (double rate, double burst, Service::RateLimitKey key)
+		:m_rate (rate),
+		 m_burst (burst),
+		 m_key (key)
 	{
-		return GetSocketAddress(m_port);
+		NS_ASSERT(rate > 0);
+		NS_ASSERT(burst >= 1);
 	}
 
-protected:
-	void OnReceiveRequest (Ptr<Message> msg, Address from)
+	// consumes a token of the client of the request - false if the client is over its quota
+	bool TryAcquire (Ptr<Message> msg)
 	{
-		NS_ASSERT (msg != NULL);
-		m_onReceiveRequest(msg, from);
-	}
+		NS_ASSERT(msg != NULL);
 
-}; // ServerMessageEndpoint
+		uint32_t									client;
+		map<uint32_t, TokenBucket>::iterator		it;
 
 
+		client = (m_key == Service::RateLimitBySourceService) ? msg->GetSrcService() : msg->GetOriginService();
+		it = m_buckets.find(client);
 
+		// a new client starts with full bucket
+		if (it == m_buckets.end())
+		{
+			TokenBucket		bucket;
 
+			bucket.tokens = m_burst;
+			bucket.lastRefill = Simulator::Now();
+			it = m_buckets.insert(make_pair(client, bucket)).first;
+		}
 
+		it->second.tokens = min(m_burst, it->second.tokens + m_rate * (Simulator::Now() - it->second.lastRefill).GetSeconds());
+		it->second.lastRefill = Simulator::Now();
 
-class EndpointMessageIdCache : public Object, public InstanceCounter
-{
-private:
-	const Time						m_msgIdLifetime;
-	map<uint32_t, Time> 			m_ids;
-	EventId							m_removeOldRecordsEvent;
+		if (it->second.tokens < 1)
+		{
+			s_clientCounts[client].limited++;
+			return false;
+		}
 
-public:
+		it->second.tokens -= 1;
+		s_clientCounts[client].passed++;
 
-	EndpointMessageIdCache (Ptr<ServiceBase> serviceBase)
-	:InstanceCounter(typeid(this).name()),
-	 m_msgIdLifetime(serviceBase->GetMsgIdLifetime())
-	{
-		// will start scheduled cache cleanup
+		return true;
+	}
+
+	static bool IsUsed () { return !s_clientCounts.empty(); }
+
+	static void WriteOutClientCounts ()
+	{
+		map<uint32_t, ClientCounts>::const_iterator		it;
+
+
+		for (it = s_clientCounts.begin(); it != s_clientCounts.end(); it++)
+		{
+			NS_LOG_UNCOND("		Rate limiting - client " << it->first << " - passed requests: " << it->second.passed << ", limited requests: " << it->second.limited);
+		}
+	}
+
+}; // ClientRateLimiter
+
+map<uint32_t, ClientRateLimiter::ClientCounts>		ClientRateLimiter::s_clientCounts;
+
+
+#define ADMISSION_AIMD_BACKOFF		0.9
+
+
+/*
+ * Admission control of a service instance
+ * 		Consulted by the server endpoint for each new request - rejected requests are answered with
+ * 		exception immediately, admitted ones are in flight until their task is released.
+ * 			ConcurrencyLimit - at most limit requests in flight
+ * 			QueueDelayTarget - CoDel-like, requests are rejected once the queue delay (wait for a worker
+ * 				slot) stayed above target for interval, until a delay below target is observed or no
+ * 				request is in flight; needs the worker pool, without it requests do not wait
+ * 			AdaptiveLimit - AIMD, the in flight limit grows by one per limit requests processed within
+ * 				target (arrival till response issued), it is cut by ADMISSION_AIMD_BACKOFF on a slower one
+ */
+class AdmissionController : public Object
+{
+public:
+
+	enum Policy
+	{
+		ConcurrencyLimit,
+		QueueDelayTarget,
+		AdaptiveLimit
+	};
+
+private:
+	const Policy					m_policy;
+	const uint32_t					m_maxLimit;
+	const Time						m_target;
+	const Time						m_interval;
+	const uint32_t					m_serviceId;
+	const Ptr<SimulationOutput>		m_simulationOutput;
+	double							m_limit;
+	uint32_t						m_inFlight;
+	Time							m_queueDelay;
+	// time the queue delay is above target for interval - 0 if below target
+	Time							m_aboveTargetUntil;
+	bool							m_isRejecting;
+
+	static uint32_t					s_numberOfAdmittedRequests;
+	static uint32_t					s_numberOfRejectedRequests;
+
+public:
+
+	AdmissionController (
+			Policy policy,
+			uint32_t limit,
+			Time target,
+			Time interval,
+			uint32_t serviceId,
+			Ptr<SimulationOutput> simulationOutput)
+		:m_policy (policy),
+		 m_maxLimit (limit),
+		 m_target (target),
+		 m_interval (interval),
+		 m_serviceId (serviceId),
+		 m_simulationOutput (simulationOutput),
+		 m_limit (limit),
+		 m_inFlight (0),
+		 m_queueDelay (Seconds(0)),
+		 m_aboveTargetUntil (Seconds(0)),
+		 m_isRejecting (false)
+	{
+		NS_ASSERT(limit > 0);
+		NS_ASSERT(simulationOutput != NULL);
+	}
+
+	virtual ~AdmissionController() {}
+
+	bool Admit ()
+	{
+		bool		isAdmitted;
+
+
+		if (m_policy == QueueDelayTarget)
+		{
+			isAdmitted = !m_isRejecting;
+		}
+		else
+		{
+			isAdmitted = m_inFlight < (uint32_t)m_limit;
+		}
+
+		if (isAdmitted)
+		{
+			m_inFlight++;
+			s_numberOfAdmittedRequests++;
+		}
+		else
+		{
+			s_numberOfRejectedRequests++;
+		}
+
+		m_simulationOutput->RecordAdmission(
+				m_serviceId,
+				isAdmitted,
+				m_inFlight,
+				(uint32_t)m_limit,
+				m_queueDelay);
+
+		return isAdmitted;
+	}
+
+	// admitted request waited for its processing
+	void OnRequestStarted (Time queueDelay)
+	{
+		m_queueDelay = queueDelay;
+
+		if (queueDelay < m_target)
+		{
+			m_aboveTargetUntil = Seconds(0);
+			m_isRejecting = false;
+		}
+		else if (m_aboveTargetUntil == Seconds(0))
+		{
+			m_aboveTargetUntil = Simulator::Now() + m_interval;
+		}
+		else if (Simulator::Now() >= m_aboveTargetUntil)
+		{
+			m_isRejecting = true;
+		}
+	}
+
+	// admitted request processed - latency from its arrival
+	void OnRequestProcessed (Time latency)
+	{
+		if (m_policy != AdaptiveLimit)
+		{
+			return;
+		}
+
+		if (latency <= m_target)
+		{
+			m_limit = min(m_limit + 1 / m_limit, (double)m_maxLimit);
+		}
+		else
+		{
+			m_limit = max(m_limit * ADMISSION_AIMD_BACKOFF, 1.0);
+		}
+	}
+
+	// admitted request is not in flight any more (responded, dropped or stopped)
+	void OnRequestReleased ()
+	{
+		NS_ASSERT(m_inFlight > 0);
+
+		m_inFlight--;
+
+		// nothing waits - the queue delay is not above target any more
+		if (m_inFlight == 0)
+		{
+			m_aboveTargetUntil = Seconds(0);
+			m_isRejecting = false;
+		}
+	}
+
+	static uint32_t GetNumberOfAdmittedRequests () { return s_numberOfAdmittedRequests; }
+	static uint32_t GetNumberOfRejectedRequests () { return s_numberOfRejectedRequests; }
+
+}; // AdmissionController
+
+uint32_t		AdmissionController::s_numberOfAdmittedRequests = 0;
+uint32_t		AdmissionController::s_numberOfRejectedRequests = 0;
+
+
+class ServerMessageEndpoint : public MessageEndpoint
+{
+private:
+	Callback<void, Ptr<Message>, Address> 		m_onReceiveRequest;
+	// null if clients are not rate limited
+	Ptr<ClientRateLimiter>						m_rateLimiter;
+	Callback<void, Ptr<Message>, Address> 		m_onLimitRequest;
+	// null if every request is admitted
+	Ptr<AdmissionController>					m_admissionController;
+	Callback<void, Ptr<Message>, Address> 		m_onRejectRequest;
+
+protected:
+	uint16_t									m_port;
+
+protected:
+
+	ServerMessageEndpoint (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<SimulationOutput> simulationOutput,
+			Callback<void, Ptr<Message>, Address> onReceiveRequest,
+			uint16_t port)
+	: MessageEndpoint(node, serviceBase, simulationOutput),
+	  m_onReceiveRequest(onReceiveRequest),
+	  m_port(port)
+	{
+		NS_ASSERT (!onReceiveRequest.IsNull());
+		NS_ASSERT (port > 0);
+	}
+
+public:
+	virtual ~ServerMessageEndpoint() {}
+
+	InetSocketAddress GetServerSocketAddress ()
+	{
+		return GetSocketAddress(m_port);
+	}
+
+	// requests of clients over their quota are handed to onLimitRequest - checked before admission
+	void SetClientRateLimit (
+			Ptr<ClientRateLimiter> rateLimiter,
+			Callback<void, Ptr<Message>, Address> onLimitRequest)
+	{
+		NS_ASSERT (rateLimiter != NULL);
+		NS_ASSERT (!onLimitRequest.IsNull());
+
+		m_rateLimiter = rateLimiter;
+		m_onLimitRequest = onLimitRequest;
+	}
+
+	// requests not admitted by the controller are handed to onRejectRequest
+	void SetAdmissionControl (
+			Ptr<AdmissionController> admissionController,
+			Callback<void, Ptr<Message>, Address> onRejectRequest)
+	{
+		NS_ASSERT (admissionController != NULL);
+		NS_ASSERT (!onRejectRequest.IsNull());
+
+		m_admissionController = admissionController;
+		m_onRejectRequest = onRejectRequest;
+	}
+
+protected:
+	void OnReceiveRequest (Ptr<Message> msg, Address from)
+	{
+		NS_ASSERT (msg != NULL);
+
+		// client over its quota - not considered for admission
+		if (m_rateLimiter != NULL && !m_rateLimiter->TryAcquire(msg))
+		{
+			m_onLimitRequest(msg, from);
+			return;
+		}
+
+		if (m_admissionController != NULL && !m_admissionController->Admit())
+		{
+			m_onRejectRequest(msg, from);
+			return;
+		}
+
+		m_onReceiveRequest(msg, from);
+	}
+
+}; // ServerMessageEndpoint
+
+
+
+
+
+
+class EndpointMessageIdCache : public Object, public InstanceCounter
+{
+private:
+	const Time						m_msgIdLifetime;
+	map<uint32_t, Time> 			m_ids;
+	EventId							m_removeOldRecordsEvent;
+
+public:
+
+	EndpointMessageIdCache (Ptr<ServiceBase> serviceBase)
+	:InstanceCounter(typeid(this).name()),
+	 m_msgIdLifetime(serviceBase->GetMsgIdLifetime())
+	{
+		// will start scheduled cache cleanup
 		RemoveOldRecords();
 	}
 
@@ -2597,6 +4141,8 @@ private:
 	uint32_t				m_retransmissionCounter;
 	Ptr<EndpointMessageIdCache>		m_msgCache;
 
+	static uint32_t			s_numberOfShortenedTimeouts;
+
 /*
 	static uint32_t		counter;
 	static uint32_t		currentCount;
@@ -2673,6 +4219,8 @@ public:
 		Transition_StartSendMessage();
 	}
 
+	static uint32_t GetNumberOfShortenedTimeouts () { return s_numberOfShortenedTimeouts; }
+
 private:
 
 	void ReceiveMessage (Ptr<Socket> socket)
@@ -3080,10 +4628,21 @@ private:
 		m_requestMessage->WriteOut();}
 */
 
+		Time		responseTimeout = m_serviceBase->GetResponseTimeout();
+
+
 		Response_CancelTimeout();
 
+		// response is not awaited after the deadline of the conversation - a response being sent
+		// is left to its ACK, otherwise neither its success nor failure is reported
+		if (m_waitForResponse && m_requestMessage->HasDeadline() && m_requestMessage->GetDeadline() - Simulator::Now() < responseTimeout)
+		{
+			responseTimeout = m_requestMessage->IsDeadlineExpired() ? Seconds(0) : m_requestMessage->GetDeadline() - Simulator::Now();
+			s_numberOfShortenedTimeouts++;
+		}
+
 		m_responseTimeoutEvent = Simulator::Schedule (
-				m_serviceBase->GetResponseTimeout(),
+				responseTimeout,
 				&UdpClientMessageEndpoint::Response_TimeoutExpired,
 				this);
 	}
@@ -3115,6 +4674,8 @@ private:
 
 }; // UdpClientMessageEndpoint
 
+uint32_t UdpClientMessageEndpoint::s_numberOfShortenedTimeouts = 0;
+
 //uint32_t UdpClientMessageEndpoint::counter = 0;
 //uint32_t UdpClientMessageEndpoint::currentCount = 0;
 
@@ -3304,6 +4865,7 @@ public:
  *
  * defines following:
  * - ServiceRegistry
+ * - NodeCpu							- processing capacity shared by services of a node
  * - RunningTaskManager					- manager of tasks running in single service / service thread collection
  * - RequestProcessingTask				- pseudo thread - processing of single request in service - instantiated per request
  * - ServiceInstance
@@ -3319,6 +4881,11 @@ private:
 	Ptr<Service> 		m_service;
 	Address 			m_serviceAddress;
 	uint32_t 			m_nodeId;
+	uint32_t			m_outstandingRequests;
+	bool				m_isRegistered;
+	uint32_t			m_consecutiveTimeouts;
+	Time				m_suspectedUntil;
+	uint32_t			m_selectionMark;
 
 public:
 
@@ -3328,7 +4895,11 @@ public:
 			uint32_t nodeId)
 	:m_service(service),
 	 m_serviceAddress(serviceAddress),
-	 m_nodeId(nodeId)
+	 m_nodeId(nodeId),
+	 m_outstandingRequests(0),
+	 m_isRegistered(true),
+	 m_consecutiveTimeouts(0),
+	 m_selectionMark(0)
 	{
 		NS_ASSERT(service != NULL);
 	}
@@ -3351,813 +4922,4853 @@ public:
 		return m_serviceAddress;
 	}
 
-}; // ServiceRegistryRecord
-
-
-
-
-class ServiceRegistryServiceSelector : public Object
-{
-public:
-
-	virtual Ptr<ServiceRegistryRecord> SelectService (
-			Ptr<Node> srcNode,
-			uint32_t destContractId,
-			set<Ptr<ServiceRegistryRecord> > destRecords) = 0;
+	// requests sent to the service and not yet completed (response, timeout or failure)
+	uint32_t GetOutstandingRequests ()
+	{
+		return m_outstandingRequests;
+	}
 
-}; // ServiceRegistryServiceSelector
+	void IncrementOutstandingRequests ()
+	{
+		m_outstandingRequests++;
+	}
 
+	void DecrementOutstandingRequests ()
+	{
+		NS_ASSERT(m_outstandingRequests > 0);
 
-class ServiceRegistryServiceSelectorHopDistance : public ServiceRegistryServiceSelector
-{
-public:
+		m_outstandingRequests--;
+	}
 
-	virtual Ptr<ServiceRegistryRecord> SelectService (
-			Ptr<Node> srcNode,
-			uint32_t destContractId,
-			set<Ptr<ServiceRegistryRecord> > destRecords)
+	// false after the service was deregistered (stopped)
+	bool IsRegistered ()
 	{
-		set<Ptr<ServiceRegistryRecord> >::iterator 		it;
-		Ptr<ServiceRegistryRecord>						record;
-		uint32_t										recordDistance;
-		uint32_t										nearestRecordDistance = 1000;
-		Ptr<ServiceRegistryRecord>						nearestRecord;
+		return m_isRegistered;
+	}
 
+	void SetDeregistered ()
+	{
+		m_isRegistered = false;
+	}
 
-		// set first record as default
-		nearestRecord = *destRecords.begin();
+	bool IsSuspected ()
+	{
+		return Simulator::Now() < m_suspectedUntil;
+	}
 
-		//NS_LOG_UNCOND("msg to destContractId: " << destContractId);
+	// returns true if the record became suspected
+	bool OnRequestTimeout (uint32_t suspicionThreshold, Time suspicionPeriod)
+	{
+		m_consecutiveTimeouts++;
 
-		for (it=destRecords.begin(); it!=destRecords.end(); it++)
+		if (suspicionThreshold == 0 || m_consecutiveTimeouts < suspicionThreshold)
 		{
-			record = *it;
-			recordDistance = GetHopDistanceOfNode(srcNode, record->GetServiceAddress());
-
-			//NS_LOG_UNCOND(" node: " << record->GetNodeId() << " distance: " << recordDistance);
-
-			if (recordDistance > 0 && recordDistance < nearestRecordDistance)
-			{
-				nearestRecord = record;
-				nearestRecordDistance = recordDistance;
-			}
+			return false;
 		}
 
-		//NS_LOG_UNCOND(" selected node: " << nearestRecord->GetNodeId());
+		m_consecutiveTimeouts = 0;
+		m_suspectedUntil = Simulator::Now() + suspicionPeriod;
 
-		return nearestRecord;
+		return true;
 	}
 
-	int GetHopDistanceOfNode(Ptr<Node> srcNode, Address destServiceAddress)
+	void OnRequestResponded ()
 	{
-		Ptr<RoutingProtocol> 					routing = srcNode->GetObject<RoutingProtocol>();
-        vector<RoutingTableEntry> 				entry = routing->GetRoutingTableEntries();
-        vector<RoutingTableEntry>::iterator 	it;
-        InetSocketAddress						destNodeAddress = InetSocketAddress::ConvertFrom(destServiceAddress);
-
-
-		//NS_LOG_UNCOND("routing table for node: " << srcNode->GetId() << " dest node: " << destNodeAddress.GetIpv4());
+		m_consecutiveTimeouts = 0;
+		m_suspectedUntil = Seconds(0);
+	}
 
-        for (it=entry.begin(); it!=entry.end(); it++)
-        {
-    		//NS_LOG_UNCOND("destination node: " << it->destAddr << " distance: " << it->distance);
+	// selectors tag the candidates of a selection - membership is tested without searching the candidates
+	uint32_t GetSelectionMark ()
+	{
+		return m_selectionMark;
+	}
 
-        	if (it->destAddr == destNodeAddress.GetIpv4())
-        	{
-        		//NS_LOG_UNCOND("found == ");
+	void SetSelectionMark (uint32_t mark)
+	{
+		m_selectionMark = mark;
+	}
 
-        		return it->distance;
-        	}
-        }
+}; // ServiceRegistryRecord
 
-        return 0;
-	}
 
-}; // ServiceRegistryServiceSelectorHopDistance
 
 
-class ServiceRegistryServiceSelectorPhysicalDistance : public ServiceRegistryServiceSelector
+class ServiceRegistryServiceSelector : public Object
 {
+private:
+	// alternates of the ranking - reused
+	vector<pair<uint32_t, uint32_t> >		m_alternates;
+
 public:
 
 	virtual Ptr<ServiceRegistryRecord> SelectService (
 			Ptr<Node> srcNode,
 			uint32_t destContractId,
-			set<Ptr<ServiceRegistryRecord> > destRecords)
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords) = 0;
+
+	/*
+	 * Selection with the request identification - conversationId is 0 for the first request
+	 * of a new conversation, callerId is id of the requesting client/service
+	 * Selectors not routing by request use SelectService.
+	 * */
+	virtual Ptr<ServiceRegistryRecord> SelectServiceForRequest (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t conversationId,
+			uint32_t callerId)
 	{
-		Ptr<MobilityModel> 								srcMm = srcNode->GetObject<MobilityModel>();
-		Ptr<Node> 										destNode;
-		Ptr<MobilityModel>								destMm;
-		set<Ptr<ServiceRegistryRecord> >::iterator 		it;
-		Ptr<ServiceRegistryRecord>						record;
-		double											recordDistance;
-		double											nearestRecordDistance = 1000;
-		Ptr<ServiceRegistryRecord>						nearestRecord;
+		return SelectService(srcNode, destContractId, destRecords);
+	}
 
+	/*
+	 * Ranked candidates for a request - up to count distinct records, the preferred first
+	 * Default ranking selects the first record as a single request would be routed, alternates
+	 * follow by the least outstanding requests - state of the selector is advanced only once.
+	 * */
+	virtual void RankServicesForRequest (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t conversationId,
+			uint32_t callerId,
+			uint32_t count,
+			vector<Ptr<ServiceRegistryRecord> > & rankedRecords)
+	{
+		Ptr<ServiceRegistryRecord>		selectedRecord;
 
-		// set first record as default
-		nearestRecord = *destRecords.begin();
 
-		//NS_LOG_UNCOND("msg to destContractId: " << destContractId);
+		rankedRecords.clear();
 
-		for (it=destRecords.begin(); it!=destRecords.end(); it++)
+		if (count == 0 || destRecords.empty())
 		{
-			record = *it;
-			destNode = NodeContainer::GetGlobal().Get(record->GetNodeId());
-			destMm = destNode->GetObject<MobilityModel>();
+			return;
+		}
 
-			recordDistance = CalculateDistance(
-				srcMm->GetPosition(),
-				destMm->GetPosition());
+		selectedRecord = SelectServiceForRequest(srcNode, destContractId, destRecords, conversationId, callerId);
+		rankedRecords.push_back(selectedRecord);
 
-			//NS_LOG_UNCOND(" src position: " << srcMm->GetPosition() << " dest position: " << destMm->GetPosition());
-			//NS_LOG_UNCOND(" node: " << record->GetNodeId() << " distance: " << recordDistance);
+		// (outstanding requests, index) - ties keep the order of the candidates
+		m_alternates.clear();
 
-			if (recordDistance < nearestRecordDistance)
+		for (uint32_t i = 0; i < destRecords.size(); i++)
+		{
+			if (destRecords[i] != selectedRecord)
 			{
-				nearestRecord = record;
-				nearestRecordDistance = recordDistance;
+				m_alternates.push_back(make_pair(destRecords[i]->GetOutstandingRequests(), i));
 			}
 		}
 
-		//NS_LOG_UNCOND(" selected node: " << nearestRecord->GetNodeId());
+		count = min(count - 1, (uint32_t) m_alternates.size());
+		partial_sort(m_alternates.begin(), m_alternates.begin() + count, m_alternates.end());
 
-		return nearestRecord;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			rankedRecords.push_back(destRecords[m_alternates[i].second]);
+		}
 	}
 
-}; // ServiceRegistryServiceSelectorPhysicalDistance
-
-
-class ServiceRegistryServiceSelectorSingleService : public ServiceRegistryServiceSelector
-{
-public:
+	// notification from ServiceRegistry - allows selectors to maintain their own indexes of records
+	virtual void OnServiceRegistered (Ptr<ServiceRegistryRecord> record) {}
+	virtual void OnServiceDeregistered (Ptr<ServiceRegistryRecord> record) {}
 
-	virtual Ptr<ServiceRegistryRecord> SelectService (
+	// notification from ServiceRegistry - request sent from srcNode to the service of the record
+	virtual void OnRequestStarted (
 			Ptr<Node> srcNode,
-			uint32_t destContractId,
-			set<Ptr<ServiceRegistryRecord> > destRecords)
-	{
-		return *destRecords.begin();
-	}
-
-}; // ServiceRegistryServiceSelectorSingleService
+			Ptr<ServiceRegistryRecord> record) {}
 
+	// notification from ServiceRegistry - outcome of request sent from srcNode to the service of the record
+	virtual void OnRequestCompleted (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record,
+			bool success,
+			Time responseTime) {}
 
+	// notification from ServiceRegistry - request sent from srcNode abandoned without outcome
+	virtual void OnRequestCancelled (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record) {}
 
+}; // ServiceRegistryServiceSelector
 
 
-class ServiceRegistry
+class NodeHopDistanceCache : public Object
 {
 private:
-
-	// key is serviceId
-	static map <uint32_t, Ptr<ServiceRegistryRecord> > 			s_serviceRecords;
-
-	// key is contractId
-	static multimap <uint32_t, Ptr<ServiceRegistryRecord> > 	s_contractRecords;
-
-	static Ptr<ServiceRegistryServiceSelector>					s_serviceSelector;
-
+	Ptr<RoutingProtocol>				m_routing;
+	map<Ipv4Address, uint32_t>			m_distances;
+	bool								m_isValid;
 
 public:
 
-	static void Initialize (Ptr<ServiceRegistryServiceSelector> serviceSelector)
-	{
-		NS_ASSERT(serviceSelector != NULL);
-
-		s_serviceSelector = serviceSelector;
-	}
-
-	static void RegisterService (
-			Ptr<Service> service,
-			Address serviceAddress,
-			uint32_t nodeId)
+	NodeHopDistanceCache (Ptr<Node> node)
+	:m_isValid(false)
 	{
-		NS_ASSERT(service != NULL);
-
-		Ptr<ServiceRegistryRecord>		record = CreateObject<ServiceRegistryRecord>(
-				service,
-				serviceAddress,
-				nodeId);
+		NS_ASSERT(node != NULL);
 
-		s_serviceRecords.insert(
-				make_pair(
-						service->GetServiceId(),
-						record));
+		m_routing = node->GetObject<RoutingProtocol>();
+		NS_ASSERT(m_routing != NULL);
 
-		s_contractRecords.insert(
-				make_pair(
-						service->GetContractId(),
-						record));
+		// cache is rebuilt lazily on next lookup after OLSR reports change of its routing table
+		m_routing->TraceConnectWithoutContext(
+				"RoutingTableChanged",
+				MakeCallback(&NodeHopDistanceCache::OnRoutingTableChanged, this));
 	}
 
-	static set<Ptr<ServiceRegistryRecord> > GetServiceRecords (uint32_t contractId)
+	virtual ~NodeHopDistanceCache ()
+	{}
+
+	uint32_t GetHopDistance (Ipv4Address destAddress)
 	{
-		NS_ASSERT(contractId > 0);
+		map<Ipv4Address, uint32_t>::const_iterator 		it;
 
-		//ServiceRegistry::WriteOut();
 
-		set<Ptr<ServiceRegistryRecord> >  								records;
-		Ptr<ServiceRegistryRecord> 										record;
-		multimap <uint32_t, Ptr<ServiceRegistryRecord> >::iterator		it;
-		pair<
-			multimap<uint32_t, Ptr<ServiceRegistryRecord> >::iterator,
-			multimap<uint32_t, Ptr<ServiceRegistryRecord> >::iterator> 	it_pair;
+		if (!m_isValid)
+		{
+			Rebuild();
+		}
 
-		it_pair = s_contractRecords.equal_range(contractId);
+		it = m_distances.find(destAddress);
 
-		for (it = it_pair.first; it != it_pair.second; it++ )
+		if (it == m_distances.end())
 		{
-			record = it->second;
-			records.insert(record);
+			return 0;
 		}
 
-		return records;
+		return it->second;
 	}
 
-	static Ptr<ServiceRegistryRecord> SelectDestinationService(
-			Ptr<Node> srcNode,
-			uint32_t destContractId)
-	{
-		NS_ASSERT(s_serviceSelector != NULL);
-
-		set<Ptr<ServiceRegistryRecord> >				records;
-
-
-		records = GetServiceRecords(destContractId);
-		NS_ASSERT(records.size() != 0);
+private:
 
-		return s_serviceSelector->SelectService(srcNode, destContractId, records);
+	void OnRoutingTableChanged (uint32_t size)
+	{
+		m_isValid = false;
 	}
 
-	static void WriteOut()
+	void Rebuild ()
 	{
-		map <uint32_t, Ptr<ServiceRegistryRecord> >::iterator 			rit;
-		Ptr<ServiceRegistryRecord>										record;
+		vector<RoutingTableEntry> 					entry = m_routing->GetRoutingTableEntries();
+		vector<RoutingTableEntry>::const_iterator 	it;
 
 
-		NS_LOG_UNCOND("Service registry state ...");
-		NS_LOG_UNCOND("	# of records: " << s_serviceRecords.size());
+		m_distances.clear();
 
-		for (rit=s_serviceRecords.begin() ; rit != s_serviceRecords.end(); rit++ )
+		for (it=entry.begin(); it!=entry.end(); it++)
 		{
-			record = rit->second;
-		 	NS_LOG_UNCOND("Service: " << record->GetService()->GetServiceId()
-					<< ", contract: " << record->GetService()->GetContractId()
-					<< ", node: " << record->GetNodeId()
-					<< ", address: " << record->GetServiceAddress());
+			m_distances.insert(make_pair(it->destAddr, it->distance));
 		}
 
-		NS_LOG_UNCOND("End of service registry state");
+		m_isValid = true;
 	}
 
-}; // ServiceRegistry
-
-map<uint32_t, Ptr<ServiceRegistryRecord> > 				ServiceRegistry::s_serviceRecords;
-multimap<uint32_t, Ptr<ServiceRegistryRecord> > 		ServiceRegistry::s_contractRecords;
-Ptr<ServiceRegistryServiceSelector>						ServiceRegistry::s_serviceSelector;
+}; // NodeHopDistanceCache
 
 
-class ExecutionPlanExecuter : public Object, public InstanceCounter
+class ServiceRegistryServiceSelectorHopDistance : public ServiceRegistryServiceSelector
 {
 private:
-	const Ptr<Node> 					m_node;
-	const Ptr<Message>					m_conversationMsg;
-	const Ptr<ExecutionPlan>			m_plan;
-	Ptr<ClientMessageEndpoint>			m_clientEndpoint;
-	EventId								m_executeTaskEvent;
-
-protected:
-	const Ptr<ServiceBase>				m_serviceBase;
-	const Ptr<SimulationOutput> 		m_simulationOutput;
+	// key is nodeId
+	map<uint32_t, Ptr<NodeHopDistanceCache> >		m_nodeCaches;
+	// (distance, index of candidate) of the ranking - reused
+	vector<pair<uint32_t, uint32_t> >				m_rankedDistances;
 
 public:
 
-	ExecutionPlanExecuter (
-			Ptr<Node> node,
-			Ptr<ServiceBase> serviceBase,
-			Ptr<Message> conversationMsg,
-			Ptr<SimulationOutput> simulationOutput,
-			Ptr<ExecutionPlan> plan)
-			:InstanceCounter(typeid(this).name()),
-			 m_node(node),
-			 m_conversationMsg(conversationMsg),
-			 m_plan (plan),
-			 m_serviceBase(serviceBase),
-			 m_simulationOutput(simulationOutput)
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
 	{
-		// conversationMsg - can be null
-		NS_ASSERT(node != NULL);
-		NS_ASSERT(serviceBase != 0);
-		NS_ASSERT(simulationOutput != NULL);
-		NS_ASSERT(plan != NULL);
-	}
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator 	it;
+		Ptr<ServiceRegistryRecord>								record;
+		uint32_t												recordDistance;
+		uint32_t												nearestRecordDistance = 1000;
+		Ptr<ServiceRegistryRecord>								nearestRecord;
+		Ptr<NodeHopDistanceCache>								cache = GetNodeCache(srcNode);
 
-	virtual ~ExecutionPlanExecuter()
-	{
-		Stop();
-	}
 
-	void Start ()
-	{
-		NS_ASSERT(m_clientEndpoint == NULL);
+		// set first record as default
+		nearestRecord = destRecords.front();
 
-		m_clientEndpoint = MessageEndpointFactory::CreateClientMessageEndpoint(
-				m_node,
-				m_serviceBase,
-				m_simulationOutput,
-				MakeCallback(&ExecutionPlanExecuter::Request_onSendSuccessCallback, this),
-				MakeCallback(&ExecutionPlanExecuter::Request_onSendFailureCallback, this),
-				MakeCallback(&ExecutionPlanExecuter::Request_onReceiveResponseCallback, this),
-				MakeCallback(&ExecutionPlanExecuter::Request_onResponseTimeoutCallback, this));
+		//NS_LOG_UNCOND("msg to destContractId: " << destContractId);
 
-		m_clientEndpoint->Open();
+		for (it=destRecords.begin(); it!=destRecords.end(); it++)
+		{
+			record = *it;
+			recordDistance = cache->GetHopDistance(
+					InetSocketAddress::ConvertFrom(record->GetServiceAddress()).GetIpv4());
 
-		OnStart();
+			//NS_LOG_UNCOND(" node: " << record->GetNodeId() << " distance: " << recordDistance);
+
+			if (recordDistance > 0 && recordDistance < nearestRecordDistance)
+			{
+				nearestRecord = record;
+				nearestRecordDistance = recordDistance;
+			}
+		}
+
+		//NS_LOG_UNCOND(" selected node: " << nearestRecord->GetNodeId());
+
+		return nearestRecord;
 	}
 
-	void Stop ()
+	// count nearest candidates - candidates of unknown distance last
+	virtual void RankServicesForRequest (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t conversationId,
+			uint32_t callerId,
+			uint32_t count,
+			vector<Ptr<ServiceRegistryRecord> > & rankedRecords)
 	{
-		m_executeTaskEvent.Cancel();
+		Ptr<NodeHopDistanceCache>								cache = GetNodeCache(srcNode);
+		uint32_t												recordDistance;
 
-		if(m_clientEndpoint != NULL)
-		{
-			m_clientEndpoint->Close();
-			m_clientEndpoint = NULL;
-		}
-	}
 
-protected:
+		rankedRecords.clear();
+		m_rankedDistances.clear();
 
-	virtual void OnStart() = 0;
-	virtual void ExecuteNextStep () = 0;
-	virtual void Request_onSendSuccessCallback() = 0;
-	virtual void Request_onSendFailureCallback() = 0;
-	virtual void Request_onReceiveResponseCallback(Ptr<Message> msg) = 0;
-	virtual void Request_onResponseTimeoutCallback() = 0;
+		for (uint32_t i = 0; i < destRecords.size(); i++)
+		{
+			recordDistance = cache->GetHopDistance(
+					InetSocketAddress::ConvertFrom(destRecords[i]->GetServiceAddress()).GetIpv4());
 
-	void ExecuteNextStepWithDelay (RandomVariable delay)
-	{
-		Time			delayValue = MilliSeconds(delay.GetInteger());
+			m_rankedDistances.push_back(make_pair(recordDistance > 0 ? recordDistance : UINT_MAX, i));
+		}
+
+		count = min(count, (uint32_t) m_rankedDistances.size());
+		partial_sort(m_rankedDistances.begin(), m_rankedDistances.begin() + count, m_rankedDistances.end());
 
-		m_executeTaskEvent = Simulator::Schedule (delayValue, &ExecutionPlanExecuter::ExecuteNextStep, this);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			rankedRecords.push_back(destRecords[m_rankedDistances[i].second]);
+		}
 	}
 
-	void ExecuteSendMessage (uint32_t index)
+	int GetHopDistanceOfNode(Ptr<Node> srcNode, Address destServiceAddress)
 	{
-		NS_ASSERT(index < m_plan->GetExecutionStepsCount());
-
-		const Ptr<ExecutionStep> 		executionStep = m_plan->GetExecutionStep(index);
-		uint32_t 						contractId = executionStep->GetContractId();
-		uint32_t 						contractMethodId = executionStep->GetContractMethodId();
-		Ptr<ServiceRegistryRecord> 		registryRecord = FindRequestDestination(contractId);
-		uint32_t						size = executionStep->GetRequestSize().GetInteger();
+		InetSocketAddress						destNodeAddress = InetSocketAddress::ConvertFrom(destServiceAddress);
 
 
-		SendMessage(
-				registryRecord->GetNodeId(),
-				registryRecord->GetService()->GetServiceId(),
-				registryRecord->GetServiceAddress(),
-				contractMethodId,
-				size);
+		return GetNodeCache(srcNode)->GetHopDistance(destNodeAddress.GetIpv4());
 	}
 
 private:
 
-	void SendMessage(uint32_t destNode, uint32_t destService, Address to, uint32_t destMethod, uint32_t size)
+	Ptr<NodeHopDistanceCache> GetNodeCache (Ptr<Node> srcNode)
 	{
-		Ptr<Message> 	msg = CreateObject<Message>();
+		map<uint32_t, Ptr<NodeHopDistanceCache> >::iterator 	it;
+		Ptr<NodeHopDistanceCache>								cache;
 
 
-		// new conversation
-		if (m_conversationMsg == NULL)
-		{
-			msg->InitializeNew(
-							m_node->GetId(),
-							m_serviceBase->GetServiceId(),
-							destNode,
-							destService,
-							destMethod,
-							size);
-		}
-		else // continue conversation
+		it = m_nodeCaches.find(srcNode->GetId());
+
+		if (it != m_nodeCaches.end())
 		{
-			msg->InitializeNext (
-					m_conversationMsg,
-					destNode,
-					destService,
-					destMethod,
-					size);
+			return it->second;
 		}
 
-		m_clientEndpoint->SendMessage(msg, to, true);
-	}
+		cache = CreateObject<NodeHopDistanceCache>(srcNode);
+		m_nodeCaches.insert(make_pair(srcNode->GetId(), cache));
 
-	Ptr<ServiceRegistryRecord> FindRequestDestination(uint32_t contractId)
-	{
-		return ServiceRegistry::SelectDestinationService(
-				m_node,
-				contractId);
+		return cache;
 	}
 
-}; // ExecutionPlanExecuter
+}; // ServiceRegistryServiceSelectorHopDistance
 
 
-class ServiceExecutionPlanExecuter : public ExecutionPlanExecuter
+class ServiceSpatialGridIndex : public Object
 {
 private:
-	const Ptr<ServiceExecutionPlan>		m_servicePlan;
-	int		 							m_currentStep;
-	Callback<void, bool> 				m_onExecutionStop;
-	const RandomVariable				m_stepSelector;
-	EventId								m_finishedWithErrorDelay;
 
+	struct GridEntry
+	{
+		Ptr<ServiceRegistryRecord>		record;
+		Vector							position;
+		Vector							velocity;
+		Time							updateTime;
+		pair<int32_t, int32_t>			cell;
+	};
+
+	const double													m_cellSize;
+	vector<GridEntry>												m_entries;
+	// key is contractId, value is map of cells to indexes of entries in the cell
+	map<uint32_t, map<pair<int32_t, int32_t>, vector<uint32_t> > >	m_contractCells;
+	// key is contractId, value is number of entries
+	map<uint32_t, uint32_t>											m_contractEntriesCount;
+	// key is mobility model of node hosting the service(s), value is indexes of entries
+	map<const MobilityModel *, vector<uint32_t> >					m_mobilityEntries;
+	double															m_maxSpeed;
+	Time															m_lastRefresh;
+	// (distance, index of entry) of the search in progress - reused
+	vector<pair<double, uint32_t> >									m_nearestEntries;
 
 public:
 
-	ServiceExecutionPlanExecuter (
-			Ptr<Node> node,
-			Ptr<ServiceBase> serviceBase,
-			Ptr<Message> conversationMsg,
-			Ptr<SimulationOutput> simulationOutput,
-			Ptr<ServiceExecutionPlan> servicePlan,
-			Callback<void, bool> onExecutionStop)
-			:ExecutionPlanExecuter(
-					node,
-					serviceBase,
-					conversationMsg,
-					simulationOutput,
-					servicePlan),
-			 m_servicePlan(servicePlan),
-			 m_onExecutionStop(onExecutionStop),
-			 m_stepSelector (UniformVariable(0, 100))
+	ServiceSpatialGridIndex (double cellSize)
+	:m_cellSize(cellSize),
+	 m_maxSpeed(0)
 	{
-		NS_ASSERT(servicePlan != NULL);
-		NS_ASSERT(!onExecutionStop.IsNull());
+		NS_ASSERT(cellSize > 0);
 	}
 
-	virtual ~ServiceExecutionPlanExecuter()
+	virtual ~ServiceSpatialGridIndex ()
+	{}
+
+	void AddRecord (Ptr<ServiceRegistryRecord> record)
 	{
-		Stop();
-		m_finishedWithErrorDelay.Cancel();
-	}
+		NS_ASSERT(record != NULL);
 
-protected:
+		Ptr<Node>						node = NodeContainer::GetGlobal().Get(record->GetNodeId());
+		Ptr<MobilityModel>				mobility = node->GetObject<MobilityModel>();
+		uint32_t						contractId = record->GetService()->GetContractId();
+		uint32_t						index = m_entries.size();
+		GridEntry						entry;
 
-	virtual void OnStart()
-	{
-		m_currentStep = -1;
-		ExecuteNextStep();
-	}
 
-	virtual void ExecuteNextStep ()
-	{
-		int stepsCount = (int)m_servicePlan->GetExecutionStepsCount();
+		NS_ASSERT(mobility != NULL);
 
+		entry.record = record;
+		entry.position = mobility->GetPosition();
+		entry.velocity = mobility->GetVelocity();
+		entry.updateTime = Simulator::Now();
+		entry.cell = GetCell(entry.position);
 
-		// first step - pre exe delay
-		if (m_currentStep == -1)
+		m_entries.push_back(entry);
+		m_contractCells[contractId][entry.cell].push_back(index);
+		m_contractEntriesCount[contractId]++;
+		UpdateMaxSpeed(entry.velocity);
+
+		// first service on the node - start following the node's course changes
+		if (m_mobilityEntries.find(PeekPointer(mobility)) == m_mobilityEntries.end())
 		{
-			ExecuteNextStepWithDelay (m_servicePlan->GetPlanPreExeDelay());
-			m_currentStep++;
-			return;
+			mobility->TraceConnectWithoutContext(
+					"CourseChange",
+					MakeCallback(&ServiceSpatialGridIndex::OnCourseChange, this));
 		}
 
-		// send request step(s)
-		if (m_currentStep < stepsCount)
-		{
-			// find step to execute - based on configured probability of steps
-			m_currentStep = FindStepToExecute();
+		m_mobilityEntries[PeekPointer(mobility)].push_back(index);
+	}
 
-			// step found
-			if (m_currentStep < stepsCount)
+	// entry stays in place (without record) - indexes of other entries are not affected
+	void RemoveRecord (Ptr<ServiceRegistryRecord> record)
+	{
+		NS_ASSERT(record != NULL);
+
+		Ptr<Node>						node = NodeContainer::GetGlobal().Get(record->GetNodeId());
+		vector<uint32_t> &				nodeEntries = m_mobilityEntries[PeekPointer(node->GetObject<MobilityModel>())];
+		uint32_t						contractId = record->GetService()->GetContractId();
+		map<pair<int32_t, int32_t>, vector<uint32_t> > & 	cells = m_contractCells[contractId];
+		vector<uint32_t>::iterator		it;
+
+
+		for (it = nodeEntries.begin(); it != nodeEntries.end(); it++)
+		{
+			if (m_entries[*it].record == record)
 			{
-				ExecuteSendMessage(m_currentStep);
-				m_currentStep++;
-				return;
+				break;
 			}
 		}
 
-		// last step - post exe delay
-		if (m_currentStep == stepsCount)
+		if (it == nodeEntries.end())
 		{
-			ExecuteNextStepWithDelay (m_servicePlan->GetPlanPostExeDelay());
-			m_currentStep++;
 			return;
 		}
 
-		// end of execution
-		if (m_currentStep > stepsCount)
+		vector<uint32_t> &				cell = cells[m_entries[*it].cell];
+
+
+		cell.erase(find(cell.begin(), cell.end(), *it));
+
+		if (cell.empty())
 		{
-			PlanFinished(true);
-			return;
+			cells.erase(m_entries[*it].cell);
 		}
+
+		m_contractEntriesCount[contractId]--;
+		m_entries[*it].record = NULL;
+		nodeEntries.erase(it);
 	}
 
-	virtual void Request_onSendSuccessCallback()
-	{}
+	/*
+	 * Up to count nearest records of the contract to the position (up to maxDistance), the nearest
+	 * first, among records tagged with candidateMark - other records (suspected, not discovered)
+	 * are skipped
+	 *
+	 * How it works
+	 *
+	 * Rings of cells around the cell of the position are visited one by one, each ring one cell further.
+	 * Positions of entries are extrapolated from the last course change of the entry, cells of entries
+	 * may be stale by the drift of the nodes since the last refresh of the index, this is taken into
+	 * account when deciding if next ring may contain nearer entry.
+	 * Search ends when no nearer entry can be found (count entries found and the farthest of them
+	 * is nearer than the next ring), all entries of the contract were visited or the rings exceeded
+	 * maxDistance.
+	 * */
+	void FindNearestRecords (
+			uint32_t contractId,
+			Vector position,
+			double maxDistance,
+			uint32_t candidateMark,
+			uint32_t count,
+			vector<Ptr<ServiceRegistryRecord> > & nearestRecords)
+	{
+		map<uint32_t, map<pair<int32_t, int32_t>, vector<uint32_t> > >::iterator	cit;
+		map<pair<int32_t, int32_t>, vector<uint32_t> >::const_iterator				it;
+		vector<uint32_t>::const_iterator											eit;
+		vector<pair<double, uint32_t> >::iterator									nit;
+		pair<int32_t, int32_t>														srcCell = GetCell(position);
+		double																		distance;
+		double																		drift;
+		uint32_t																	entriesCount;
+		uint32_t																	visitedEntries = 0;
+		int32_t																		maxRing;
+
+
+		nearestRecords.clear();
+		m_nearestEntries.clear();
+
+		cit = m_contractCells.find(contractId);
+
+		if (cit == m_contractCells.end() || count == 0)
+		{
+			return;
+		}
 
-	virtual void Request_onSendFailureCallback()
-	{
-		ExecutePlanFinishedWithErrorDelay();
+		RefreshIfDrifted();
+
+		drift = GetMaxDrift();
+		entriesCount = m_contractEntriesCount[contractId];
+		maxRing = (int32_t) ceil((maxDistance + drift) / m_cellSize) + 1;
+
+		for (int32_t r = 0; r <= maxRing; r++)
+		{
+			for (int32_t dx = -r; dx <= r; dx++)
+			{
+				for (int32_t dy = -r; dy <= r; dy++)
+				{
+					// cells of the ring only
+					if (abs(dx) != r && abs(dy) != r)
+					{
+						continue;
+					}
+
+					it = cit->second.find(make_pair(srcCell.first + dx, srcCell.second + dy));
+
+					if (it == cit->second.end())
+					{
+						continue;
+					}
+
+					for (eit = it->second.begin(); eit != it->second.end(); eit++)
+					{
+						visitedEntries++;
+
+						if (m_entries[*eit].record->GetSelectionMark() != candidateMark)
+						{
+							continue;
+						}
+
+						distance = CalculateDistance(position, GetEntryPosition(m_entries[*eit]));
+
+						if (distance >= maxDistance
+								|| (m_nearestEntries.size() == count && distance >= m_nearestEntries.back().first))
+						{
+							continue;
+						}
+
+						// sorted by the distance - the farthest is dropped when full
+						nit = upper_bound(m_nearestEntries.begin(), m_nearestEntries.end(), make_pair(distance, *eit));
+						m_nearestEntries.insert(nit, make_pair(distance, *eit));
+
+						if (m_nearestEntries.size() > count)
+						{
+							m_nearestEntries.pop_back();
+						}
+					}
+				}
+			}
+
+			if (visitedEntries == entriesCount)
+			{
+				break;
+			}
+
+			// entries in further rings are at least r cells away (less the drift)
+			if (m_nearestEntries.size() == count && m_nearestEntries.back().first <= (r * m_cellSize) - drift)
+			{
+				break;
+			}
+		}
+
+		for (nit = m_nearestEntries.begin(); nit != m_nearestEntries.end(); nit++)
+		{
+			nearestRecords.push_back(m_entries[nit->second].record);
+		}
 	}
 
-	virtual void Request_onReceiveResponseCallback(Ptr<Message> msg)
+private:
+
+	void OnCourseChange (Ptr<const MobilityModel> mobility)
 	{
-		NS_ASSERT(msg != NULL);
+		map<const MobilityModel *, vector<uint32_t> >::const_iterator 		it;
+		vector<uint32_t>::const_iterator									eit;
 
-		// delay of the step
-		const RandomVariable 		delay 			= m_servicePlan->GetStepPostExeDelay();
 
+		it = m_mobilityEntries.find(PeekPointer(mobility));
 
-		// check for exception - if yes cancel the task
-		if (msg->GetMessageType() == Message::MTResponseException)
+		if (it == m_mobilityEntries.end())
 		{
-			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_RECEIVED_EXCEPTION, msg);
-			ExecutePlanFinishedWithErrorDelay();
+			return;
 		}
-		else
+
+		UpdateMaxSpeed(mobility->GetVelocity());
+
+		for (eit = it->second.begin(); eit != it->second.end(); eit++)
 		{
-			ExecuteNextStepWithDelay(delay);
+			UpdateEntry(*eit, mobility->GetPosition(), mobility->GetVelocity());
 		}
 	}
 
-	virtual void Request_onResponseTimeoutCallback()
+	void UpdateEntry (uint32_t index, Vector position, Vector velocity)
 	{
-		ExecutePlanFinishedWithErrorDelay();
+		GridEntry &								entry = m_entries[index];
+		pair<int32_t, int32_t>					cell = GetCell(position);
+
+
+		entry.position = position;
+		entry.velocity = velocity;
+		entry.updateTime = Simulator::Now();
+
+		if (cell != entry.cell)
+		{
+			MoveEntry(index, cell);
+		}
 	}
 
-	void ExecutePlanFinishedWithErrorDelay()
+	void MoveEntry (uint32_t index, pair<int32_t, int32_t> cell)
 	{
-		Time			delayValue = MilliSeconds(m_servicePlan->GetPostPlanErrorDelay().GetInteger());
+		GridEntry &								entry = m_entries[index];
+		map<pair<int32_t, int32_t>, vector<uint32_t> > & 	cells = m_contractCells[entry.record->GetService()->GetContractId()];
+		vector<uint32_t> &						oldCell = cells[entry.cell];
 
 
-		m_finishedWithErrorDelay = Simulator::Schedule (
-				delayValue,
-				&ServiceExecutionPlanExecuter::PlanFinished,
-				this,
-				false);
+		oldCell.erase(find(oldCell.begin(), oldCell.end(), index));
+
+		if (oldCell.empty())
+		{
+			cells.erase(entry.cell);
+		}
+
+		entry.cell = cell;
+		cells[cell].push_back(index);
 	}
 
-	void PlanFinished(bool success)
+	// rebins all entries to their extrapolated positions when the drift exceeds half of the cell
+	void RefreshIfDrifted ()
 	{
-		Stop();
-		m_onExecutionStop(success);
+		if (GetMaxDrift() <= m_cellSize / 2)
+		{
+			return;
+		}
+
+		for (uint32_t i = 0; i < m_entries.size(); i++)
+		{
+			if (m_entries[i].record != NULL)
+			{
+				UpdateEntry(i, GetEntryPosition(m_entries[i]), m_entries[i].velocity);
+			}
+		}
+
+		m_lastRefresh = Simulator::Now();
 	}
 
-	uint32_t FindStepToExecute()
+	double GetMaxDrift () const
 	{
-		double 			stepProbability;
-		uint32_t		step;
-		uint32_t		stepsCount = m_servicePlan->GetExecutionStepsCount();
+		return m_maxSpeed * (Simulator::Now() - m_lastRefresh).GetSeconds();
+	}
 
+	Vector GetEntryPosition (const GridEntry & entry) const
+	{
+		double			dt = (Simulator::Now() - entry.updateTime).GetSeconds();
 
-		step = m_currentStep;
 
-		while (step < stepsCount)
-		{
-			stepProbability = m_servicePlan->GetExecutionStep(step)->GetStepProbability();
+		return Vector(
+				entry.position.x + entry.velocity.x * dt,
+				entry.position.y + entry.velocity.y * dt,
+				entry.position.z + entry.velocity.z * dt);
+	}
 
-			//NS_LOG_UNCOND("step selection - step: " << step << " p:" << stepProbability);
+	void UpdateMaxSpeed (Vector velocity)
+	{
+		double			speed = sqrt(velocity.x * velocity.x + velocity.y * velocity.y + velocity.z * velocity.z);
 
-			if (m_stepSelector.GetValue () <= stepProbability)
-			{
-				//NS_LOG_UNCOND("selected");
-				return step;
-			}
 
-			step++;
+		if (speed > m_maxSpeed)
+		{
+			m_maxSpeed = speed;
 		}
-
-		//NS_LOG_UNCOND("no step selected");
-		return stepsCount;
 	}
 
-}; // ServiceExecutionPlanExecuter
-
+	pair<int32_t, int32_t> GetCell (Vector position) const
+	{
+		return make_pair(
+				(int32_t) floor(position.x / m_cellSize),
+				(int32_t) floor(position.y / m_cellSize));
+	}
 
+}; // ServiceSpatialGridIndex
 
 
-class ClientExecutionPlanExecuter : public ExecutionPlanExecuter
+class ServiceRegistryServiceSelectorPhysicalDistance : public ServiceRegistryServiceSelector
 {
 private:
-	const Ptr<ClientExecutionPlan>				m_clientPlan;
-	const RandomVariable						m_stepSelector;
-	const RandomVariable						m_stepProbabilitySelector;
-	uint32_t									m_latestStep;
+	const double							m_maxDistance;
+	Ptr<ServiceSpatialGridIndex>			m_index;
+	uint32_t								m_selectionMark;
+	// (distance, index of candidate) of the fallback ranking - reused
+	vector<pair<double, uint32_t> >			m_rankedDistances;
 
 public:
 
-	ClientExecutionPlanExecuter (
-			Ptr<Node> node,
-			Ptr<ServiceBase> serviceBase,
-			Ptr<Message> conversationMsg,
-			Ptr<SimulationOutput> simulationOutput,
-			Ptr<ClientExecutionPlan> clientPlan)
-			:ExecutionPlanExecuter(
-					node,
-					serviceBase,
-					conversationMsg,
-					simulationOutput,
-					clientPlan),
-			m_clientPlan (clientPlan),
-			m_stepSelector (UniformVariable(0, m_clientPlan->GetExecutionStepsCount())),
-			m_stepProbabilitySelector (UniformVariable(0, 100))
+	ServiceRegistryServiceSelectorPhysicalDistance (double cellSize = 100, double maxDistance = 1000)
+	:m_maxDistance(maxDistance),
+	 m_selectionMark(0)
 	{
-		NS_ASSERT(clientPlan != NULL);
+		NS_ASSERT(maxDistance > 0);
+
+		m_index = CreateObject<ServiceSpatialGridIndex>(cellSize);
 	}
 
-	virtual ~ClientExecutionPlanExecuter()
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
 	{
-		Stop();
-	}
+		vector<Ptr<ServiceRegistryRecord> >				nearestRecords;
 
-protected:
 
-	virtual void OnStart()
-	{
-		WaitBeforeNextStep();
+		RankNearestCandidates(srcNode, destContractId, destRecords, 1, nearestRecords);
+
+		//NS_LOG_UNCOND(" selected node: " << nearestRecords.front()->GetNodeId());
+
+		return nearestRecords.front();
 	}
 
-	virtual void ExecuteNextStep ()
+	// count nearest candidates
+	virtual void RankServicesForRequest (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t conversationId,
+			uint32_t callerId,
+			uint32_t count,
+			vector<Ptr<ServiceRegistryRecord> > & rankedRecords)
 	{
-		uint32_t step = FindNextStepToExecute();
+		RankNearestCandidates(srcNode, destContractId, destRecords, count, rankedRecords);
+	}
 
-		//NS_LOG_UNCOND("client: ExecuteNextStep clientid " << m_serviceBase->GetServiceId() << " stepid: " << step);
+	virtual void OnServiceRegistered (Ptr<ServiceRegistryRecord> record)
+	{
+		m_index->AddRecord(record);
+	}
 
-		ExecuteSendMessage(step);
+	virtual void OnServiceDeregistered (Ptr<ServiceRegistryRecord> record)
+	{
+		m_index->RemoveRecord(record);
 	}
 
-	uint32_t FindNextStepToExecute()
+private:
+
+	void RankNearestCandidates (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t count,
+			vector<Ptr<ServiceRegistryRecord> > & rankedRecords)
 	{
-		double 					stepProbability;
-		uint32_t				step;
+		Vector			position = srcNode->GetObject<MobilityModel>()->GetPosition();
 
 
-		while (true)
-		{
-			step = m_stepSelector.GetInteger();
+		// the index covers all registered records - only destRecords are searched (others are
+		// suspected or not discovered by the source node)
+		MarkCandidates(destRecords);
 
-			stepProbability = m_clientPlan->GetExecutionStep(step)->GetStepProbability();
+		m_index->FindNearestRecords(destContractId, position, m_maxDistance, m_selectionMark, count, rankedRecords);
 
-			if (m_stepProbabilitySelector.GetValue () <= stepProbability)
-			{
-				return step;
-			}
+		// not enough candidates in max distance - the nearest candidates regardless of the distance
+		if (rankedRecords.size() < min(count, (uint32_t) destRecords.size()))
+		{
+			RankByDistance(position, destRecords, count, rankedRecords);
 		}
 	}
 
-	void WaitBeforeNextStep()
+	void MarkCandidates (const vector<Ptr<ServiceRegistryRecord> > & destRecords)
 	{
-		ExecuteNextStepWithDelay(m_clientPlan->GetRequestRate());
-	}
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator 	it;
 
-	void WaitAfterFailure()
-	{
-		//NS_LOG_UNCOND("client " << m_serviceBase->GetServiceId() << " WaitAfterFailure");
-		ExecuteNextStepWithDelay(m_clientPlan->GetAfterFailureWaitingPeriod());
-	}
 
-	virtual void Request_onSendSuccessCallback()
-	{}
+		m_selectionMark++;
 
-	virtual void Request_onSendFailureCallback()
-	{
-		WaitBeforeNextStep();
+		for (it = destRecords.begin(); it != destRecords.end(); it++)
+		{
+			(*it)->SetSelectionMark(m_selectionMark);
+		}
 	}
 
-	virtual void Request_onReceiveResponseCallback(Ptr<Message> msg)
+	void RankByDistance (
+			Vector position,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t count,
+			vector<Ptr<ServiceRegistryRecord> > & rankedRecords)
 	{
-		if (msg->GetMessageType() == Message::MTResponseException)
+		rankedRecords.clear();
+		m_rankedDistances.clear();
+
+		for (uint32_t i = 0; i < destRecords.size(); i++)
 		{
-			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_RECEIVED_EXCEPTION, msg);
-			WaitAfterFailure();
+			m_rankedDistances.push_back(make_pair(
+					CalculateDistance(
+							position,
+							NodeContainer::GetGlobal().Get(destRecords[i]->GetNodeId())->GetObject<MobilityModel>()->GetPosition()),
+					i));
 		}
-		else
+
+		count = min(count, (uint32_t) m_rankedDistances.size());
+		partial_sort(m_rankedDistances.begin(), m_rankedDistances.begin() + count, m_rankedDistances.end());
+
+		for (uint32_t i = 0; i < count; i++)
 		{
-			WaitBeforeNextStep();
+			rankedRecords.push_back(destRecords[m_rankedDistances[i].second]);
 		}
 	}
 
-	virtual void Request_onResponseTimeoutCallback()
+}; // ServiceRegistryServiceSelectorPhysicalDistance
+
+
+class ServiceRegistryServiceSelectorSingleService : public ServiceRegistryServiceSelector
+{
+public:
+
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
 	{
-		//WaitBeforeNextStep();
-		WaitAfterFailure();
+		return destRecords.front();
 	}
 
-}; // ClientExecutionPlanExecuter
+}; // ServiceRegistryServiceSelectorSingleService
 
 
 
-class ServiceRequestTask;
 
-class ServiceTaskManager : public Object, public InstanceCounter
+
+class ServiceRegistryServiceSelectorLeastOutstanding : public ServiceRegistryServiceSelector
 {
 private:
-	set<Ptr<ServiceRequestTask> > 			m_runningTasks;
+	RandomVariable				m_tieSelector;
 
 public:
 
-	ServiceTaskManager ()
-	:InstanceCounter(typeid(this).name())
+	ServiceRegistryServiceSelectorLeastOutstanding ()
+	:m_tieSelector (UniformVariable(0, 1))
 	{}
 
-	virtual ~ServiceTaskManager()
-	{
-		NS_ASSERT(m_runningTasks.size() == 0);
-	}
-
-	void AddTask(Ptr<ServiceRequestTask> task)
-	{
-		NS_ASSERT(task);
-
-		m_runningTasks.insert(task);
-	}
-
-	void RemoveTask (Ptr<ServiceRequestTask> task)
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
 	{
-		NS_ASSERT(task);
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator 	it;
+		Ptr<ServiceRegistryRecord>								selectedRecord = destRecords.front();
+		uint32_t												leastOutstanding = UINT_MAX;
+		uint32_t												ties = 0;
+		uint32_t												outstanding;
 
-		m_runningTasks.erase(task);
-	}
 
-	void StopAllTasks()
-	{
-		set<Ptr<ServiceRequestTask> >::iterator 		it;
-		Ptr<ServiceRequestTask> 						task;
+		for (it = destRecords.begin(); it != destRecords.end(); it++)
+		{
+			outstanding = (*it)->GetOutstandingRequests();
 
+			if (outstanding < leastOutstanding)
+			{
+				selectedRecord = *it;
+				leastOutstanding = outstanding;
+				ties = 1;
+			}
+			else if (outstanding == leastOutstanding)
+			{
+				// ties are broken uniformly - otherwise the first record absorbs the idle traffic
+				ties++;
 
-		for (it=m_runningTasks.begin(); it!=m_runningTasks.end(); it++)
-		{
-			task = *it;
-			//task->Stop(); !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+				if (m_tieSelector.GetValue() * ties < 1)
+				{
+					selectedRecord = *it;
+				}
+			}
 		}
 
-		NS_ASSERT(m_runningTasks.size() == 0);
+		return selectedRecord;
 	}
 
-}; // ServiceTaskManager
+}; // ServiceRegistryServiceSelectorLeastOutstanding
 
 
-class ServiceRequestTask : public Object, public InstanceCounter
+class ServiceRegistryServiceSelectorPowerOfTwoChoices : public ServiceRegistryServiceSelector
 {
 private:
-	const Ptr<Node> 					m_node;
-	const Ptr<Service> 					m_service;
-	const Ptr<Message> 					m_conversationMsg;
-	const Address 						m_requestAddress;
-	Ptr<ServiceMethod> 					m_requestMethod;
-	const Ptr<ServiceTaskManager> 		m_taskManager;
-	const Ptr<SimulationOutput> 		m_simulationOutput;
-	Ptr<ExecutionPlanExecuter>			m_planExecuter;
-	Ptr<ClientMessageEndpoint> 			m_responseEndpoint;
-	EventId								m_errorStopEvent;
+	RandomVariable				m_recordSelector;
 
-	static uint32_t						s_numberOfStartedMethods;
-	static uint32_t						s_numberOfFailedMethods;
-	static uint32_t						s_numberOfFailedExecutions;
-	static uint32_t						s_numberOfServiceFailures;
+public:
+
+	ServiceRegistryServiceSelectorPowerOfTwoChoices ()
+	:m_recordSelector (UniformVariable(0, 1))
+	{}
+
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
+	{
+		uint32_t						recordsCount = destRecords.size();
+		uint32_t						first;
+		uint32_t						second;
+
+
+		if (recordsCount == 1)
+		{
+			return destRecords.front();
+		}
+
+		// two distinct records selected uniformly
+		first = SelectIndex(recordsCount);
+		second = SelectIndex(recordsCount - 1);
+
+		if (second >= first)
+		{
+			second++;
+		}
+
+		if (destRecords[second]->GetOutstandingRequests() < destRecords[first]->GetOutstandingRequests())
+		{
+			return destRecords[second];
+		}
+
+		return destRecords[first];
+	}
+
+private:
+
+	uint32_t SelectIndex (uint32_t count)
+	{
+		uint32_t 		index = (uint32_t) (m_recordSelector.GetValue() * count);
+
+
+		return (index < count) ? index : count - 1;
+	}
+
+}; // ServiceRegistryServiceSelectorPowerOfTwoChoices
+
+
+/*
+ * Smooth weighted round robin - replicas are interleaved according to their weights
+ * instead of being selected in bursts
+ * */
+class ServiceRegistryServiceSelectorWeightedRoundRobin : public ServiceRegistryServiceSelector
+{
+private:
+	// key is serviceId
+	const map<uint32_t, int32_t>		m_weights;
+	// key is serviceId
+	map<uint32_t, int32_t>				m_currentWeights;
+
+public:
+
+	// services not present in weights have the weight of 1
+	ServiceRegistryServiceSelectorWeightedRoundRobin (map<uint32_t, int32_t> weights = map<uint32_t, int32_t>())
+	:m_weights(weights)
+	{}
+
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
+	{
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator 	it;
+		Ptr<ServiceRegistryRecord>								selectedRecord;
+		int32_t													totalWeight = 0;
+		int32_t													selectedWeight = INT_MIN;
+		int32_t													weight;
+		uint32_t												serviceId;
+
+
+		for (it = destRecords.begin(); it != destRecords.end(); it++)
+		{
+			serviceId = (*it)->GetService()->GetServiceId();
+			weight = GetWeight(serviceId);
+			totalWeight += weight;
+
+			m_currentWeights[serviceId] += weight;
+
+			if (m_currentWeights[serviceId] > selectedWeight)
+			{
+				selectedRecord = *it;
+				selectedWeight = m_currentWeights[serviceId];
+			}
+		}
+
+		m_currentWeights[selectedRecord->GetService()->GetServiceId()] -= totalWeight;
+
+		return selectedRecord;
+	}
+
+private:
+
+	int32_t GetWeight (uint32_t serviceId) const
+	{
+		map<uint32_t, int32_t>::const_iterator		it = m_weights.find(serviceId);
+
+
+		if (it == m_weights.end())
+		{
+			return 1;
+		}
+
+		NS_ASSERT(it->second > 0);
+
+		return it->second;
+	}
+
+}; // ServiceRegistryServiceSelectorWeightedRoundRobin
+
+
+/*
+ * Selects the replica with the best expected latency observed from the source node
+ *
+ * How it works
+ *
+ * Response time and failure rate are kept as exponentially weighted moving averages per
+ * (source node, service). Expected latency of a replica is its average response time weighted
+ * by the failure rate against the failure penalty (cost of the timeout). Replicas not yet
+ * observed from the source node are preferred, so every replica gets probed at least once.
+ * A single probe is sent to such replica - till its outcome arrives the replica is probe pending
+ * and the other replicas are ranked instead (a dead replica holds one request, not all of them).
+ * With exploration probability a replica is selected uniformly - recovered replicas and replicas
+ * which got closer due to mobility are re-probed.
+ * */
+class ServiceRegistryServiceSelectorLatencyEwma : public ServiceRegistryServiceSelector
+{
+private:
+
+	struct LatencyEstimate
+	{
+		double		responseTime; // ms
+		double		failureRate;
+		bool		hasResponseTime;
+	};
+
+	const double									m_alpha;
+	const double									m_explorationProbability;
+	const double									m_failurePenalty; // ms
+	RandomVariable									m_explorationSelector;
+	// key is (source nodeId, serviceId)
+	map<pair<uint32_t, uint32_t>, LatencyEstimate>	m_estimates;
+	// key is (source nodeId, serviceId), value is number of probes sent and not yet completed
+	map<pair<uint32_t, uint32_t>, uint32_t>			m_pendingProbes;
+
+public:
+
+	ServiceRegistryServiceSelectorLatencyEwma (
+			double alpha = 0.2,
+			double explorationProbability = 0.05,
+			Time failurePenalty = MilliSeconds(60000))
+	:m_alpha(alpha),
+	 m_explorationProbability(explorationProbability),
+	 m_failurePenalty(failurePenalty.GetMilliSeconds()),
+	 m_explorationSelector (UniformVariable(0, 1))
+	{
+		NS_ASSERT(alpha > 0 && alpha <= 1);
+		NS_ASSERT(explorationProbability >= 0 && explorationProbability <= 1);
+	}
+
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
+	{
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator 		it;
+		map<pair<uint32_t, uint32_t>, LatencyEstimate>::iterator	eit;
+		pair<uint32_t, uint32_t>									key;
+		Ptr<ServiceRegistryRecord>									selectedRecord = destRecords.front();
+		double														selectedLatency = -1;
+		double														latency;
+		uint32_t													index;
+
+
+		if (destRecords.size() > 1 && m_explorationSelector.GetValue() < m_explorationProbability)
+		{
+			index = (uint32_t) (m_explorationSelector.GetValue() * destRecords.size());
+
+			return destRecords[index < destRecords.size() ? index : destRecords.size() - 1];
+		}
+
+		for (it = destRecords.begin(); it != destRecords.end(); it++)
+		{
+			key = make_pair(srcNode->GetId(), (*it)->GetService()->GetServiceId());
+			eit = m_estimates.find(key);
+
+			// not observed yet - probe unless a probe is pending
+			if (eit == m_estimates.end())
+			{
+				if (m_pendingProbes.find(key) == m_pendingProbes.end())
+				{
+					return *it;
+				}
+
+				continue;
+			}
+
+			latency = GetExpectedLatency(eit->second);
+
+			if (selectedLatency < 0 || latency < selectedLatency)
+			{
+				selectedRecord = *it;
+				selectedLatency = latency;
+			}
+		}
+
+		return selectedRecord;
+	}
+
+	// probe is pending once it is sent - selections not sent (e.g. circuit breaker open) do not count
+	virtual void OnRequestStarted (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record)
+	{
+		pair<uint32_t, uint32_t>									key = make_pair(srcNode->GetId(), record->GetService()->GetServiceId());
+
+
+		if (m_estimates.find(key) == m_estimates.end())
+		{
+			m_pendingProbes[key]++;
+		}
+	}
+
+	// probe abandoned (lost hedge, abandoned group, caller stopped) - the replica is probed again
+	virtual void OnRequestCancelled (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record)
+	{
+		map<pair<uint32_t, uint32_t>, uint32_t>::iterator			it = m_pendingProbes.find(make_pair(srcNode->GetId(), record->GetService()->GetServiceId()));
+
+
+		if (it == m_pendingProbes.end())
+		{
+			return;
+		}
+
+		if (--it->second == 0)
+		{
+			m_pendingProbes.erase(it);
+		}
+	}
+
+	virtual void OnRequestCompleted (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record,
+			bool success,
+			Time responseTime)
+	{
+		pair<uint32_t, uint32_t>									key = make_pair(srcNode->GetId(), record->GetService()->GetServiceId());
+		map<pair<uint32_t, uint32_t>, LatencyEstimate>::iterator	eit = m_estimates.find(key);
+
+
+		m_pendingProbes.erase(key);
+
+		if (eit == m_estimates.end())
+		{
+			LatencyEstimate			estimate;
+
+
+			estimate.responseTime = 0;
+			estimate.failureRate = success ? 0 : 1;
+			estimate.hasResponseTime = false;
+
+			eit = m_estimates.insert(make_pair(key, estimate)).first;
+		}
+		else
+		{
+			eit->second.failureRate += m_alpha * ((success ? 0 : 1) - eit->second.failureRate);
+		}
+
+		// response time of failures is the timeout - accounted by the failure rate only
+		if (success)
+		{
+			if (eit->second.hasResponseTime)
+			{
+				eit->second.responseTime += m_alpha * (responseTime.GetMilliSeconds() - eit->second.responseTime);
+			}
+			else
+			{
+				eit->second.responseTime = responseTime.GetMilliSeconds();
+				eit->second.hasResponseTime = true;
+			}
+		}
+	}
+
+private:
+
+	double GetExpectedLatency (const LatencyEstimate & estimate) const
+	{
+		double		responseTime = estimate.hasResponseTime ? estimate.responseTime : m_failurePenalty;
+
+
+		return (1 - estimate.failureRate) * responseTime + estimate.failureRate * m_failurePenalty;
+	}
+
+}; // ServiceRegistryServiceSelectorLatencyEwma
+
+
+/*
+ * Sticky routing - requests with the same key are routed to the same replica as long as it is available
+ *
+ * How it works
+ *
+ * Every registered replica of a contract is placed on a hash ring as a number of virtual nodes.
+ * Key (conversation or caller) is hashed onto the ring and the first virtual node clockwise
+ * whose replica is among the candidates is selected. Replica joining or leaving remaps only keys
+ * of the ring segments of its virtual nodes.
+ * The first request of a new conversation has no conversation id yet - it is keyed by the caller.
+ * */
+class ServiceRegistryServiceSelectorConsistentHash : public ServiceRegistryServiceSelector
+{
+public:
+
+	// KeyConversation keys the requests of services by their conversation - requests of clients
+	// start new conversations (no id assigned at the selection) and are keyed by the client
+	enum KeyPolicy
+	{
+		KeyConversation,
+		KeyCaller
+	};
+
+private:
+
+	struct HashRing
+	{
+		// sorted - hashes of virtual nodes and their replicas
+		vector<uint32_t>						hashes;
+		vector<Ptr<ServiceRegistryRecord> >		records;
+	};
+
+	const KeyPolicy					m_keyPolicy;
+	const uint32_t					m_virtualNodes;
+	// key is contractId
+	map<uint32_t, HashRing>			m_rings;
+
+	static uint32_t					s_numberOfSelections;
+	static uint32_t					s_numberOfRemappedSelections;
+	static uint32_t					s_numberOfCallerKeyedSelections;
+
+public:
+
+	ServiceRegistryServiceSelectorConsistentHash (KeyPolicy keyPolicy = KeyConversation, uint32_t virtualNodes = 100)
+	:m_keyPolicy(keyPolicy),
+	 m_virtualNodes(virtualNodes)
+	{
+		NS_ASSERT(virtualNodes > 0);
+	}
+
+	// without request identification the source node is the key
+	virtual Ptr<ServiceRegistryRecord> SelectService (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords)
+	{
+		return SelectByKey(destContractId, destRecords, srcNode->GetId());
+	}
+
+	virtual Ptr<ServiceRegistryRecord> SelectServiceForRequest (
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t conversationId,
+			uint32_t callerId)
+	{
+		uint32_t		key = callerId;
+
+
+		if (m_keyPolicy == KeyConversation)
+		{
+			if (conversationId != 0)
+			{
+				key = conversationId;
+			}
+			else
+			{
+				s_numberOfCallerKeyedSelections++;
+			}
+		}
+
+		return SelectByKey(destContractId, destRecords, key);
+	}
+
+	virtual void OnServiceRegistered (Ptr<ServiceRegistryRecord> record)
+	{
+		HashRing &					ring = m_rings[record->GetService()->GetContractId()];
+		vector<uint32_t>::iterator	it;
+		uint32_t					hash;
+
+
+		for (uint32_t v = 0; v < m_virtualNodes; v++)
+		{
+			hash = Hash(record->GetService()->GetServiceId() * m_virtualNodes + v);
+			it = lower_bound(ring.hashes.begin(), ring.hashes.end(), hash);
+
+			ring.records.insert(ring.records.begin() + (it - ring.hashes.begin()), record);
+			ring.hashes.insert(it, hash);
+		}
+	}
+
+	virtual void OnServiceDeregistered (Ptr<ServiceRegistryRecord> record)
+	{
+		HashRing &					ring = m_rings[record->GetService()->GetContractId()];
+		uint32_t					i = 0;
+
+
+		while (i < ring.records.size())
+		{
+			if (ring.records[i] == record)
+			{
+				ring.records.erase(ring.records.begin() + i);
+				ring.hashes.erase(ring.hashes.begin() + i);
+				continue;
+			}
+
+			i++;
+		}
+	}
+
+	static uint32_t GetNumberOfSelections () { return s_numberOfSelections; }
+	// selections where the key's replica was not a candidate and the key moved to the next one
+	static uint32_t GetNumberOfRemappedSelections () { return s_numberOfRemappedSelections; }
+	// KeyConversation selections of new conversations - keyed by the caller
+	static uint32_t GetNumberOfCallerKeyedSelections () { return s_numberOfCallerKeyedSelections; }
+
+private:
+
+	Ptr<ServiceRegistryRecord> SelectByKey (
+			uint32_t destContractId,
+			const vector<Ptr<ServiceRegistryRecord> > & destRecords,
+			uint32_t key)
+	{
+		map<uint32_t, HashRing>::iterator		rit = m_rings.find(destContractId);
+		uint32_t								index;
+		uint32_t								ringSize;
+
+
+		s_numberOfSelections++;
+
+		if (rit == m_rings.end() || rit->second.hashes.empty())
+		{
+			return destRecords.front();
+		}
+
+		ringSize = rit->second.hashes.size();
+		index = lower_bound(rit->second.hashes.begin(), rit->second.hashes.end(), Hash(key)) - rit->second.hashes.begin();
+
+		for (uint32_t i = 0; i < ringSize; i++)
+		{
+			const Ptr<ServiceRegistryRecord> &		record = rit->second.records[(index + i) % ringSize];
+
+
+			// candidates may exclude some replicas (suspected, not discovered)
+			if (find(destRecords.begin(), destRecords.end(), record) != destRecords.end())
+			{
+				if (i > 0)
+				{
+					s_numberOfRemappedSelections++;
+				}
+
+				return record;
+			}
+		}
+
+		return destRecords.front();
+	}
+
+	// murmur3 finalizer - spreads consecutive ids over the ring
+	static uint32_t Hash (uint32_t value)
+	{
+		value ^= value >> 16;
+		value *= 0x85ebca6b;
+		value ^= value >> 13;
+		value *= 0xc2b2ae35;
+		value ^= value >> 16;
+
+		return value;
+	}
+
+}; // ServiceRegistryServiceSelectorConsistentHash
+
+uint32_t ServiceRegistryServiceSelectorConsistentHash::s_numberOfSelections = 0;
+uint32_t ServiceRegistryServiceSelectorConsistentHash::s_numberOfRemappedSelections = 0;
+uint32_t ServiceRegistryServiceSelectorConsistentHash::s_numberOfCallerKeyedSelections = 0;
+
+
+#define SERVICE_DISCOVERY_PORT 				9999
+// services listen on the base plus the index of their application on the node
+#define SERVICE_PORT_BASE_ID 				10000
+#define SERVICE_DISCOVERY_FORWARD_JITTER 	10 // ms
+
+
+class ServiceAnnouncement : public Header
+{
+private:
+	uint32_t m_serviceId;
+	uint32_t m_contractId;
+	uint32_t m_originNode;
+	uint32_t m_sequence;
+	uint32_t m_hopsLeft;
+
+public:
+
+	ServiceAnnouncement ()
+	:m_serviceId(0),
+	 m_contractId(0),
+	 m_originNode(0),
+	 m_sequence(0),
+	 m_hopsLeft(0)
+	{}
+
+	ServiceAnnouncement (
+			uint32_t serviceId,
+			uint32_t contractId,
+			uint32_t originNode,
+			uint32_t sequence,
+			uint32_t hopsLeft)
+	:m_serviceId(serviceId),
+	 m_contractId(contractId),
+	 m_originNode(originNode),
+	 m_sequence(sequence),
+	 m_hopsLeft(hopsLeft)
+	{}
+
+	uint32_t GetServiceId () const { return m_serviceId; }
+	uint32_t GetContractId () const { return m_contractId; }
+	uint32_t GetOriginNode () const { return m_originNode; }
+	uint32_t GetSequence () const { return m_sequence; }
+	uint32_t GetHopsLeft () const { return m_hopsLeft; }
+
+	static TypeId GetTypeId (void)
+	{
+		static TypeId tid = TypeId ("ns3::ServiceAnnouncement").SetParent<Header> ();
+
+		return tid;
+	}
+
+	virtual TypeId GetInstanceTypeId (void) const { return GetTypeId (); }
+	virtual uint32_t GetSerializedSize (void) const { return 20; }
+	virtual void Print (std::ostream &os) const {}
+
+	virtual void Serialize (Buffer::Iterator start) const
+	{
+		start.WriteU32 (m_serviceId);
+		start.WriteU32 (m_contractId);
+		start.WriteU32 (m_originNode);
+		start.WriteU32 (m_sequence);
+		start.WriteU32 (m_hopsLeft);
+	}
+
+	virtual uint32_t Deserialize (Buffer::Iterator start)
+	{
+		m_serviceId = start.ReadU32();
+		m_contractId = start.ReadU32();
+		m_originNode = start.ReadU32();
+		m_sequence = start.ReadU32();
+		m_hopsLeft = start.ReadU32();
+		return 20;
+	}
+
+}; // ServiceAnnouncement
+
+
+/*
+ * Node-local view of the services - populated by announcements received over the network
+ *
+ * How it works
+ *
+ * Services hosted on the node are announced periodically by broadcast. Announcements are flooded,
+ * each node forwards announcement not seen before (by sequence of the service) while hop limit
+ * allows. Received announcements are cached for TTL. Services of the node itself are always known.
+ * Records of services are resolved by serviceId from records announced so far - the announcement
+ * stands for the record (node, address) of the service.
+ * */
+class ServiceDiscoveryAgent : public Object
+{
+private:
+
+	struct CacheEntry
+	{
+		Ptr<ServiceRegistryRecord>		record;
+		Time							expiry;
+	};
+
+	const Ptr<Node>									m_node;
+	const Ptr<SimulationOutput> 					m_simulationOutput;
+	const Time										m_announcementPeriod;
+	const Time										m_cacheTtl;
+	const uint32_t									m_hopLimit;
+	Ptr<Socket>										m_socket;
+	EventId											m_announceEvent;
+	RandomVariable									m_jitter;
+	uint32_t										m_sequence;
+	// key is serviceId
+	map<uint32_t, Ptr<ServiceRegistryRecord> >		m_localServices;
+	// key is serviceId, value is the last sequence seen
+	map<uint32_t, uint32_t>							m_seenSequences;
+	// key is contractId, then serviceId
+	map<uint32_t, map<uint32_t, CacheEntry> >		m_cache;
+	// records of the last lookup - reused
+	vector<Ptr<ServiceRegistryRecord> >				m_cachedRecords;
+
+	// key is serviceId
+	static map<uint32_t, Ptr<ServiceRegistryRecord> >	s_announcedRecords;
+
+	static uint32_t									s_numberOfAnnouncementsSent;
+	static uint32_t									s_numberOfAnnouncementsForwarded;
+	static uint32_t									s_numberOfAnnouncementsReceived;
+	static uint32_t									s_numberOfBytesSent;
+	static uint32_t									s_numberOfCacheHits;
+	static uint32_t									s_numberOfCacheMisses;
+
+public:
+
+	ServiceDiscoveryAgent (
+			Ptr<Node> node,
+			Ptr<SimulationOutput> simulationOutput,
+			Time announcementPeriod,
+			Time cacheTtl,
+			uint32_t hopLimit)
+	:m_node(node),
+	 m_simulationOutput(simulationOutput),
+	 m_announcementPeriod(announcementPeriod),
+	 m_cacheTtl(cacheTtl),
+	 m_hopLimit(hopLimit),
+	 m_jitter(UniformVariable(0, 1)),
+	 m_sequence(0)
+	{
+		NS_ASSERT(node != NULL);
+		NS_ASSERT(simulationOutput != NULL);
+		NS_ASSERT(hopLimit > 0);
+	}
+
+	virtual ~ServiceDiscoveryAgent ()
+	{
+		Stop();
+	}
+
+	void Start ()
+	{
+		NS_ASSERT(m_socket == NULL);
+
+		int result;
+
+
+		m_socket = Socket::CreateSocket (m_node, UdpSocketFactory::GetTypeId ());
+		result = m_socket->Bind (InetSocketAddress (Ipv4Address::GetAny (), SERVICE_DISCOVERY_PORT));
+		NS_ASSERT (result == 0);
+		m_socket->SetAllowBroadcast (true);
+		m_socket->SetRecvCallback (MakeCallback(&ServiceDiscoveryAgent::ReceiveAnnouncement, this));
+
+		// nodes do not announce in sync
+		m_announceEvent = Simulator::Schedule (
+				MilliSeconds(m_jitter.GetValue() * m_announcementPeriod.GetMilliSeconds()),
+				&ServiceDiscoveryAgent::AnnounceLocalServices,
+				this);
+	}
+
+	void Stop ()
+	{
+		m_announceEvent.Cancel();
+
+		if (m_socket != NULL)
+		{
+			m_socket->Close();
+			m_socket = NULL;
+		}
+	}
+
+	void AddLocalService (Ptr<ServiceRegistryRecord> record)
+	{
+		NS_ASSERT(record != NULL);
+
+		m_localServices[record->GetService()->GetServiceId()] = record;
+		s_announcedRecords[record->GetService()->GetServiceId()] = record;
+	}
+
+	// service is no longer announced - caches of other nodes keep it until TTL
+	void RemoveLocalService (uint32_t serviceId)
+	{
+		m_localServices.erase(serviceId);
+	}
+
+	const vector<Ptr<ServiceRegistryRecord> > & GetCachedRecords (uint32_t contractId)
+	{
+		map<uint32_t, Ptr<ServiceRegistryRecord> >::iterator 		lit;
+		map<uint32_t, map<uint32_t, CacheEntry> >::iterator			cit;
+		map<uint32_t, CacheEntry>::iterator							eit;
+
+
+		m_cachedRecords.clear();
+
+		for (lit = m_localServices.begin(); lit != m_localServices.end(); lit++)
+		{
+			if (lit->second->GetService()->GetContractId() == contractId)
+			{
+				m_cachedRecords.push_back(lit->second);
+			}
+		}
+
+		cit = m_cache.find(contractId);
+
+		if (cit != m_cache.end())
+		{
+			eit = cit->second.begin();
+
+			while (eit != cit->second.end())
+			{
+				if (eit->second.expiry <= Simulator::Now())
+				{
+					cit->second.erase(eit++);
+					continue;
+				}
+
+				if (m_localServices.find(eit->first) == m_localServices.end())
+				{
+					m_cachedRecords.push_back(eit->second.record);
+				}
+
+				eit++;
+			}
+		}
+
+		if (m_cachedRecords.empty())
+		{
+			s_numberOfCacheMisses++;
+		}
+		else
+		{
+			s_numberOfCacheHits++;
+		}
+
+		return m_cachedRecords;
+	}
+
+	static uint32_t GetNumberOfAnnouncementsSent () { return s_numberOfAnnouncementsSent; }
+	static uint32_t GetNumberOfAnnouncementsForwarded () { return s_numberOfAnnouncementsForwarded; }
+	static uint32_t GetNumberOfAnnouncementsReceived () { return s_numberOfAnnouncementsReceived; }
+	static uint32_t GetNumberOfBytesSent () { return s_numberOfBytesSent; }
+	static uint32_t GetNumberOfCacheHits () { return s_numberOfCacheHits; }
+	static uint32_t GetNumberOfCacheMisses () { return s_numberOfCacheMisses; }
+
+private:
+
+	void AnnounceLocalServices ()
+	{
+		map<uint32_t, Ptr<ServiceRegistryRecord> >::iterator 		lit;
+
+
+		m_sequence++;
+
+		for (lit = m_localServices.begin(); lit != m_localServices.end(); lit++)
+		{
+			SendAnnouncement(
+					ServiceAnnouncement(
+							lit->first,
+							lit->second->GetService()->GetContractId(),
+							m_node->GetId(),
+							m_sequence,
+							m_hopLimit));
+
+			s_numberOfAnnouncementsSent++;
+		}
+
+		m_announceEvent = Simulator::Schedule (m_announcementPeriod, &ServiceDiscoveryAgent::AnnounceLocalServices, this);
+	}
+
+	void ForwardAnnouncement (ServiceAnnouncement announcement)
+	{
+		if (m_socket == NULL)
+		{
+			return;
+		}
+
+		SendAnnouncement(announcement);
+		s_numberOfAnnouncementsForwarded++;
+	}
+
+	void SendAnnouncement (ServiceAnnouncement announcement)
+	{
+		Ptr<Packet> 		packet = Create<Packet>(0);
+
+
+		packet->AddHeader(announcement);
+		m_socket->SendTo(packet, 0, InetSocketAddress (Ipv4Address::GetBroadcast (), SERVICE_DISCOVERY_PORT));
+
+		s_numberOfBytesSent += announcement.GetSerializedSize();
+
+		m_simulationOutput->RecordDiscoveryMessage(
+				MESSAGE_ACTION_SEND,
+				m_node->GetId(),
+				announcement.GetServiceId(),
+				announcement.GetContractId(),
+				announcement.GetOriginNode(),
+				announcement.GetSequence(),
+				announcement.GetHopsLeft(),
+				announcement.GetSerializedSize());
+	}
+
+	void ReceiveAnnouncement (Ptr<Socket> socket)
+	{
+		Ptr<Packet> 										packet;
+		Address 											from;
+		map<uint32_t, uint32_t>::iterator					sit;
+		map<uint32_t, Ptr<ServiceRegistryRecord> >::iterator	rit;
+
+
+		while ((packet = socket->RecvFrom (from)))
+		{
+			ServiceAnnouncement 		announcement;
+
+
+			packet->RemoveHeader (announcement);
+			s_numberOfAnnouncementsReceived++;
+
+			m_simulationOutput->RecordDiscoveryMessage(
+					MESSAGE_ACTION_RECEIVE,
+					m_node->GetId(),
+					announcement.GetServiceId(),
+					announcement.GetContractId(),
+					announcement.GetOriginNode(),
+					announcement.GetSequence(),
+					announcement.GetHopsLeft(),
+					announcement.GetSerializedSize());
+
+			// own announcement forwarded back
+			if (announcement.GetOriginNode() == m_node->GetId())
+			{
+				continue;
+			}
+
+			// already seen - duplicate by flooding
+			sit = m_seenSequences.find(announcement.GetServiceId());
+
+			if (sit != m_seenSequences.end() && sit->second >= announcement.GetSequence())
+			{
+				continue;
+			}
+
+			m_seenSequences[announcement.GetServiceId()] = announcement.GetSequence();
+
+			rit = s_announcedRecords.find(announcement.GetServiceId());
+
+			if (rit == s_announcedRecords.end())
+			{
+				continue;
+			}
+
+			CacheEntry &		entry = m_cache[announcement.GetContractId()][announcement.GetServiceId()];
+
+
+			entry.record = rit->second;
+			entry.expiry = Simulator::Now() + m_cacheTtl;
+
+			if (announcement.GetHopsLeft() > 1)
+			{
+				Simulator::Schedule (
+						MilliSeconds(m_jitter.GetValue() * SERVICE_DISCOVERY_FORWARD_JITTER),
+						&ServiceDiscoveryAgent::ForwardAnnouncement,
+						this,
+						ServiceAnnouncement(
+								announcement.GetServiceId(),
+								announcement.GetContractId(),
+								announcement.GetOriginNode(),
+								announcement.GetSequence(),
+								announcement.GetHopsLeft() - 1));
+			}
+		}
+	}
+
+}; // ServiceDiscoveryAgent
+
+map<uint32_t, Ptr<ServiceRegistryRecord> >			ServiceDiscoveryAgent::s_announcedRecords;
+uint32_t											ServiceDiscoveryAgent::s_numberOfAnnouncementsSent = 0;
+uint32_t											ServiceDiscoveryAgent::s_numberOfAnnouncementsForwarded = 0;
+uint32_t											ServiceDiscoveryAgent::s_numberOfAnnouncementsReceived = 0;
+uint32_t											ServiceDiscoveryAgent::s_numberOfBytesSent = 0;
+uint32_t											ServiceDiscoveryAgent::s_numberOfCacheHits = 0;
+uint32_t											ServiceDiscoveryAgent::s_numberOfCacheMisses = 0;
+
+
+/*
+ * Circuit breakers of nodes
+ * 		Each node keeps a breaker per destination - the contract or the service record (replica) called.
+ * 		Closed - requests pass, consecutive failures are counted, the breaker opens at the threshold.
+ * 		Open - requests fail fast without touching the network until the open period elapses.
+ * 		HalfOpen - a single probe request passes, its outcome closes or reopens the breaker.
+ * 		Outcomes are fed by the registry (request completed or cancelled), executers only ask before sending.
+ */
+class CircuitBreakerRegistry
+{
+public:
+
+	enum Scope
+	{
+		PerContract,
+		PerServiceRecord
+	};
+
+	enum State
+	{
+		Closed = 'C',
+		Open = 'O',
+		HalfOpen = 'H'
+	};
+
+private:
+
+	struct Breaker
+	{
+		State			state;
+		uint32_t		consecutiveFailures;
+		Time			openedTime;
+		bool			isProbeOutstanding;
+		// probe is identified by its destination and start - outcomes of requests sent
+		// before the breaker opened do not move it out of HalfOpen
+		Ptr<ServiceRegistryRecord>	probeRecord;
+		Time			probeStartTime;
+	};
+
+	static bool												s_isEnabled;
+	static Scope											s_scope;
+	static uint32_t											s_failureThreshold;
+	static Time												s_openPeriod;
+	static Ptr<SimulationOutput>							s_simulationOutput;
+	// key is nodeId, key of inner map is the destination (contractId or serviceId by the scope)
+	static map<uint32_t, map<uint32_t, Breaker> >			s_breakers;
+
+	static uint32_t											s_numberOfOpenings;
+	static uint32_t											s_numberOfClosings;
+	static uint32_t											s_numberOfProbes;
+	static uint32_t											s_numberOfRejectedRequests;
+
+public:
+
+	static void Enable (
+			Scope scope,
+			uint32_t failureThreshold,
+			Time openPeriod,
+			Ptr<SimulationOutput> simulationOutput)
+	{
+		NS_ASSERT(failureThreshold > 0);
+		NS_ASSERT(simulationOutput != NULL);
+
+		s_isEnabled = true;
+		s_scope = scope;
+		s_failureThreshold = failureThreshold;
+		s_openPeriod = openPeriod;
+		s_simulationOutput = simulationOutput;
+	}
+
+	static bool IsEnabled () { return s_isEnabled; }
+
+	// asked by the executer before sending - false means fail fast
+	static bool AllowRequest (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record)
+	{
+		NS_ASSERT(record != NULL);
+
+		if (!s_isEnabled)
+		{
+			return true;
+		}
+
+		Breaker &		breaker = GetBreaker(srcNode, record);
+
+
+		switch (breaker.state)
+		{
+			case Closed:
+				return true;
+
+			case Open:
+				if (Simulator::Now() < breaker.openedTime + s_openPeriod)
+				{
+					s_numberOfRejectedRequests++;
+					return false;
+				}
+
+				Transition(srcNode, record, breaker, HalfOpen);
+				break;
+
+			case HalfOpen:
+				if (breaker.isProbeOutstanding)
+				{
+					s_numberOfRejectedRequests++;
+					return false;
+				}
+				break;
+		}
+
+		// the probe is sent now
+		breaker.isProbeOutstanding = true;
+		breaker.probeRecord = record;
+		breaker.probeStartTime = Simulator::Now();
+		s_numberOfProbes++;
+
+		return true;
+	}
+
+	// startTime is when the request was sent - only the probe's outcome decides HalfOpen breaker
+	static void OnRequestCompleted (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record,
+			bool success,
+			Time startTime)
+	{
+		NS_ASSERT(record != NULL);
+
+		if (!s_isEnabled)
+		{
+			return;
+		}
+
+		Breaker &		breaker = GetBreaker(srcNode, record);
+
+
+		if (breaker.state == HalfOpen && !IsProbe(breaker, record, startTime))
+		{
+			return;
+		}
+
+		if (success)
+		{
+			breaker.consecutiveFailures = 0;
+
+			if (breaker.state == HalfOpen)
+			{
+				s_numberOfClosings++;
+				Transition(srcNode, record, breaker, Closed);
+			}
+
+			return;
+		}
+
+		breaker.consecutiveFailures++;
+
+		if (breaker.state == HalfOpen
+				|| (breaker.state == Closed && breaker.consecutiveFailures >= s_failureThreshold))
+		{
+			s_numberOfOpenings++;
+			Transition(srcNode, record, breaker, Open);
+		}
+	}
+
+	// cancelled probe has no outcome - next request probes again
+	static void OnRequestCancelled (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record,
+			Time startTime)
+	{
+		NS_ASSERT(record != NULL);
+
+		if (!s_isEnabled)
+		{
+			return;
+		}
+
+		Breaker &		breaker = GetBreaker(srcNode, record);
+
+
+		if (IsProbe(breaker, record, startTime))
+		{
+			breaker.isProbeOutstanding = false;
+			breaker.probeRecord = NULL;
+		}
+	}
+
+	static uint32_t GetNumberOfOpenings () { return s_numberOfOpenings; }
+	static uint32_t GetNumberOfClosings () { return s_numberOfClosings; }
+	static uint32_t GetNumberOfProbes () { return s_numberOfProbes; }
+	static uint32_t GetNumberOfRejectedRequests () { return s_numberOfRejectedRequests; }
+
+private:
+
+	static Breaker & GetBreaker (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record)
+	{
+		map<uint32_t, Breaker> &				breakers = s_breakers[srcNode->GetId()];
+		uint32_t								destination = GetDestination(record);
+		map<uint32_t, Breaker>::iterator		it = breakers.find(destination);
+		Breaker									breaker;
+
+
+		if (it != breakers.end())
+		{
+			return it->second;
+		}
+
+		breaker.state = Closed;
+		breaker.consecutiveFailures = 0;
+		breaker.openedTime = Seconds(0);
+		breaker.isProbeOutstanding = false;
+
+		return breakers.insert(make_pair(destination, breaker)).first->second;
+	}
+
+	static bool IsProbe (
+			const Breaker & breaker,
+			Ptr<ServiceRegistryRecord> record,
+			Time startTime)
+	{
+		return breaker.isProbeOutstanding && breaker.probeRecord == record && breaker.probeStartTime == startTime;
+	}
+
+	static uint32_t GetDestination (Ptr<ServiceRegistryRecord> record)
+	{
+		if (s_scope == PerContract)
+		{
+			return record->GetService()->GetContractId();
+		}
+
+		return record->GetService()->GetServiceId();
+	}
+
+	static void Transition (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record,
+			Breaker & breaker,
+			State state)
+	{
+		s_simulationOutput->RecordBreakerTransition(
+				srcNode->GetId(),
+				GetDestination(record),
+				breaker.state,
+				state,
+				breaker.consecutiveFailures);
+
+		breaker.state = state;
+		breaker.isProbeOutstanding = false;
+		breaker.probeRecord = NULL;
+
+		if (state == Open)
+		{
+			breaker.openedTime = Simulator::Now();
+		}
+		else if (state == Closed)
+		{
+			breaker.consecutiveFailures = 0;
+		}
+	}
+
+}; // CircuitBreakerRegistry
+
+bool												CircuitBreakerRegistry::s_isEnabled = false;
+CircuitBreakerRegistry::Scope						CircuitBreakerRegistry::s_scope = CircuitBreakerRegistry::PerContract;
+uint32_t											CircuitBreakerRegistry::s_failureThreshold = 1;
+Time												CircuitBreakerRegistry::s_openPeriod = Seconds(0);
+Ptr<SimulationOutput>								CircuitBreakerRegistry::s_simulationOutput;
+map<uint32_t, map<uint32_t, CircuitBreakerRegistry::Breaker> >		CircuitBreakerRegistry::s_breakers;
+uint32_t											CircuitBreakerRegistry::s_numberOfOpenings = 0;
+uint32_t											CircuitBreakerRegistry::s_numberOfClosings = 0;
+uint32_t											CircuitBreakerRegistry::s_numberOfProbes = 0;
+uint32_t											CircuitBreakerRegistry::s_numberOfRejectedRequests = 0;
+
+
+#define RESPONSE_TIME_WINDOW			100
+#define RESPONSE_TIME_WINDOW_MIN_SIZE	20
+
+
+class ServiceRegistry
+{
+private:
+
+	// key is serviceId
+	static map <uint32_t, Ptr<ServiceRegistryRecord> > 			s_serviceRecords;
+
+	// index is contractId - dense index, records of each contract are stored contiguously
+	// and handed to selectors by reference, thus selection does not copy or allocate
+	static vector<vector<Ptr<ServiceRegistryRecord> > > 		s_contractRecords;
+
+	static const vector<Ptr<ServiceRegistryRecord> >			s_noRecords;
+
+public:
+
+	// cumulative load of contract - sampled by the autoscaler
+	struct ContractLoad
+	{
+		uint32_t		requests;
+		uint32_t		responses;
+		double			responseTimeSum; // ms
+	};
+
+private:
+
+	// index is contractId
+	static vector<ContractLoad>									s_contractLoads;
+
+	// recent response times of contract - ring of the latest RESPONSE_TIME_WINDOW responses
+	struct ResponseTimeWindow
+	{
+		vector<Time>		responseTimes;
+		uint32_t			next;
+	};
+
+	// index is contractId
+	static vector<ResponseTimeWindow>							s_responseTimeWindows;
+	// copy of window for percentile selection - reused
+	static vector<Time>											s_sortedResponseTimes;
+
+	static Ptr<ServiceRegistryServiceSelector>					s_serviceSelector;
+
+	// records of contract without suspected records - reused by selection
+	static vector<Ptr<ServiceRegistryRecord> >					s_liveRecords;
+
+	// consecutive timeouts to suspect a record, 0 - suspicion disabled
+	static uint32_t												s_suspicionThreshold;
+	static Time													s_suspicionPeriod;
+
+	// discovery over the network - if disabled, registry is a global oracle
+	static bool													s_isDiscoveryEnabled;
+	// key is nodeId
+	static map<uint32_t, Ptr<ServiceDiscoveryAgent> >			s_discoveryAgents;
+
+	static uint32_t												s_numberOfDeregistrations;
+	static uint32_t												s_numberOfSuspicions;
+	static uint32_t												s_numberOfRequestsToDeadServices;
+	static Time													s_timeWastedOnDeadServices;
+
+
+public:
+
+	static void Initialize (Ptr<ServiceRegistryServiceSelector> serviceSelector)
+	{
+		NS_ASSERT(serviceSelector != NULL);
+
+		map <uint32_t, Ptr<ServiceRegistryRecord> >::iterator 			rit;
+
+
+		s_serviceSelector = serviceSelector;
+
+		// services registered before the selector was set
+		for (rit=s_serviceRecords.begin() ; rit != s_serviceRecords.end(); rit++ )
+		{
+			s_serviceSelector->OnServiceRegistered(rit->second);
+		}
+	}
+
+	static void RegisterService (
+			Ptr<Service> service,
+			Address serviceAddress,
+			uint32_t nodeId)
+	{
+		NS_ASSERT(service != NULL);
+
+		Ptr<ServiceRegistryRecord>		record = CreateObject<ServiceRegistryRecord>(
+				service,
+				serviceAddress,
+				nodeId);
+		uint32_t						contractId = service->GetContractId();
+
+
+		s_serviceRecords.insert(
+				make_pair(
+						service->GetServiceId(),
+						record));
+
+		if (contractId >= s_contractRecords.size())
+		{
+			ContractLoad		noLoad = { 0, 0, 0 };
+			ResponseTimeWindow	noResponseTimes;
+
+
+			noResponseTimes.next = 0;
+
+			s_contractRecords.resize(contractId + 1);
+			s_contractLoads.resize(contractId + 1, noLoad);
+			s_responseTimeWindows.resize(contractId + 1, noResponseTimes);
+		}
+
+		s_contractRecords[contractId].push_back(record);
+
+		if (s_isDiscoveryEnabled)
+		{
+			GetDiscoveryAgent(nodeId)->AddLocalService(record);
+		}
+
+		if (s_serviceSelector != NULL)
+		{
+			s_serviceSelector->OnServiceRegistered(record);
+		}
+	}
+
+	/*
+	 * Services are announced over the network and selection is done from the node's cache
+	 * instead of the global registry - must be enabled before the simulation is started
+	 * */
+	static void EnableDiscovery (
+			NodeContainer nodes,
+			Ptr<SimulationOutput> simulationOutput,
+			Time announcementPeriod,
+			Time cacheTtl,
+			uint32_t hopLimit)
+	{
+		NS_ASSERT(!s_isDiscoveryEnabled);
+
+		map <uint32_t, Ptr<ServiceRegistryRecord> >::iterator 			rit;
+		Ptr<ServiceDiscoveryAgent>										agent;
+
+
+		for (uint32_t i = 0; i < nodes.GetN(); i++)
+		{
+			agent = CreateObject<ServiceDiscoveryAgent>(
+					nodes.Get(i),
+					simulationOutput,
+					announcementPeriod,
+					cacheTtl,
+					hopLimit);
+
+			agent->Start();
+
+			s_discoveryAgents.insert(make_pair(nodes.Get(i)->GetId(), agent));
+		}
+
+		s_isDiscoveryEnabled = true;
+
+		// services registered before discovery was enabled
+		for (rit=s_serviceRecords.begin() ; rit != s_serviceRecords.end(); rit++ )
+		{
+			GetDiscoveryAgent(rit->second->GetNodeId())->AddLocalService(rit->second);
+		}
+	}
+
+	static bool IsDiscoveryEnabled () { return s_isDiscoveryEnabled; }
+
+	/*
+	 * Record is excluded from selection for suspicionPeriod after suspicionThreshold consecutive
+	 * requests to it were not answered (response timeout or send failure)
+	 * */
+	static void ConfigureSuspicion (uint32_t suspicionThreshold, Time suspicionPeriod)
+	{
+		s_suspicionThreshold = suspicionThreshold;
+		s_suspicionPeriod = suspicionPeriod;
+	}
+
+	static void DeregisterService (uint32_t serviceId)
+	{
+		map <uint32_t, Ptr<ServiceRegistryRecord> >::iterator 			rit = s_serviceRecords.find(serviceId);
+		Ptr<ServiceRegistryRecord>										record;
+
+
+		if (rit == s_serviceRecords.end())
+		{
+			return;
+		}
+
+		record = rit->second;
+		s_serviceRecords.erase(rit);
+
+		vector<Ptr<ServiceRegistryRecord> > &	records = s_contractRecords[record->GetService()->GetContractId()];
+
+
+		records.erase(find(records.begin(), records.end(), record));
+		record->SetDeregistered();
+		s_numberOfDeregistrations++;
+
+		if (s_isDiscoveryEnabled)
+		{
+			GetDiscoveryAgent(record->GetNodeId())->RemoveLocalService(serviceId);
+		}
+
+		if (s_serviceSelector != NULL)
+		{
+			s_serviceSelector->OnServiceDeregistered(record);
+		}
+	}
+
+	static ContractLoad GetContractLoad (uint32_t contractId)
+	{
+		ContractLoad		noLoad = { 0, 0, 0 };
+
+
+		if (contractId >= s_contractLoads.size())
+		{
+			return noLoad;
+		}
+
+		return s_contractLoads[contractId];
+	}
+
+	static uint32_t GetNumberOfDeregistrations () { return s_numberOfDeregistrations; }
+	static uint32_t GetNumberOfSuspicions () { return s_numberOfSuspicions; }
+	static uint32_t GetNumberOfRequestsToDeadServices () { return s_numberOfRequestsToDeadServices; }
+	static Time GetTimeWastedOnDeadServices () { return s_timeWastedOnDeadServices; }
+
+	static const vector<Ptr<ServiceRegistryRecord> > & GetServiceRecords (uint32_t contractId)
+	{
+		NS_ASSERT(contractId > 0);
+
+		//ServiceRegistry::WriteOut();
+
+		if (contractId >= s_contractRecords.size())
+		{
+			return s_noRecords;
+		}
+
+		return s_contractRecords[contractId];
+	}
+
+	// returns null if no service of the contract is registered (or discovered by the node)
+	static Ptr<ServiceRegistryRecord> SelectDestinationService(
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			uint32_t conversationId,
+			uint32_t callerId)
+	{
+		NS_ASSERT(s_serviceSelector != NULL);
+		NS_ASSERT(destContractId > 0);
+
+		const vector<Ptr<ServiceRegistryRecord> > &		records = s_isDiscoveryEnabled
+				? GetDiscoveryAgent(srcNode->GetId())->GetCachedRecords(destContractId)
+				: GetServiceRecords(destContractId);
+
+
+		if (records.size() == 0)
+		{
+			return NULL;
+		}
+
+		return s_serviceSelector->SelectServiceForRequest(
+				srcNode,
+				destContractId,
+				GetLiveRecords(records),
+				conversationId,
+				callerId);
+	}
+
+	// ranked destinations for a request - empty if no service of the contract is registered (or discovered by the node)
+	static void SelectDestinationServices(
+			Ptr<Node> srcNode,
+			uint32_t destContractId,
+			uint32_t conversationId,
+			uint32_t callerId,
+			uint32_t count,
+			vector<Ptr<ServiceRegistryRecord> > & rankedRecords)
+	{
+		NS_ASSERT(s_serviceSelector != NULL);
+		NS_ASSERT(destContractId > 0);
+
+		const vector<Ptr<ServiceRegistryRecord> > &		records = s_isDiscoveryEnabled
+				? GetDiscoveryAgent(srcNode->GetId())->GetCachedRecords(destContractId)
+				: GetServiceRecords(destContractId);
+
+
+		rankedRecords.clear();
+
+		if (records.size() == 0)
+		{
+			return;
+		}
+
+		s_serviceSelector->RankServicesForRequest(
+				srcNode,
+				destContractId,
+				GetLiveRecords(records),
+				conversationId,
+				callerId,
+				count,
+				rankedRecords);
+	}
+
+	// percentile from (0, 100) of recent response times of contract - defaultValue until enough responses are observed
+	static Time GetResponseTimePercentile (
+			uint32_t contractId,
+			double percentile,
+			Time defaultValue)
+	{
+		uint32_t		rank;
+
+
+		if (contractId >= s_responseTimeWindows.size()
+				|| s_responseTimeWindows[contractId].responseTimes.size() < RESPONSE_TIME_WINDOW_MIN_SIZE)
+		{
+			return defaultValue;
+		}
+
+		s_sortedResponseTimes = s_responseTimeWindows[contractId].responseTimes;
+		rank = min((uint32_t)(percentile / 100 * s_sortedResponseTimes.size()), (uint32_t)s_sortedResponseTimes.size() - 1);
+
+		nth_element(s_sortedResponseTimes.begin(), s_sortedResponseTimes.begin() + rank, s_sortedResponseTimes.end());
+
+		return s_sortedResponseTimes[rank];
+	}
+
+	// feedback from the execution layer - request sent to the service
+	static void OnRequestStarted (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record)
+	{
+		NS_ASSERT(record != NULL);
+
+		record->IncrementOutstandingRequests();
+		s_contractLoads[record->GetService()->GetContractId()].requests++;
+		s_serviceSelector->OnRequestStarted(srcNode, record);
+	}
+
+	// feedback from the execution layer - response received (responded), response timeout or send failure
+	static void OnRequestCompleted (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record,
+			bool success,
+			bool responded,
+			Time responseTime)
+	{
+		NS_ASSERT(record != NULL);
+		NS_ASSERT(s_serviceSelector != NULL);
+
+		record->DecrementOutstandingRequests();
+
+		if (responded)
+		{
+			ContractLoad &			load = s_contractLoads[record->GetService()->GetContractId()];
+			ResponseTimeWindow &	window = s_responseTimeWindows[record->GetService()->GetContractId()];
+
+
+			load.responses++;
+			load.responseTimeSum += responseTime.GetMilliSeconds();
+
+			if (window.responseTimes.size() < RESPONSE_TIME_WINDOW)
+			{
+				window.responseTimes.push_back(responseTime);
+			}
+			else
+			{
+				window.responseTimes[window.next] = responseTime;
+				window.next = (window.next + 1) % RESPONSE_TIME_WINDOW;
+			}
+
+			record->OnRequestResponded();
+		}
+		else if (!record->IsRegistered())
+		{
+			s_numberOfRequestsToDeadServices++;
+			s_timeWastedOnDeadServices += responseTime;
+		}
+		else if (record->OnRequestTimeout(s_suspicionThreshold, s_suspicionPeriod))
+		{
+			s_numberOfSuspicions++;
+		}
+
+		s_serviceSelector->OnRequestCompleted(srcNode, record, success, responseTime);
+		CircuitBreakerRegistry::OnRequestCompleted(srcNode, record, success, Simulator::Now() - responseTime);
+	}
+
+	// feedback from the execution layer - request sent at startTime abandoned by the caller (e.g. caller stopped)
+	static void OnRequestCancelled (
+			Ptr<Node> srcNode,
+			Ptr<ServiceRegistryRecord> record,
+			Time startTime)
+	{
+		NS_ASSERT(record != NULL);
+
+		record->DecrementOutstandingRequests();
+		s_serviceSelector->OnRequestCancelled(srcNode, record);
+		CircuitBreakerRegistry::OnRequestCancelled(srcNode, record, startTime);
+	}
+
+private:
+
+	static Ptr<ServiceDiscoveryAgent> GetDiscoveryAgent (uint32_t nodeId)
+	{
+		map<uint32_t, Ptr<ServiceDiscoveryAgent> >::iterator 	it = s_discoveryAgents.find(nodeId);
+
+
+		NS_ASSERT(it != s_discoveryAgents.end());
+
+		return it->second;
+	}
+
+	// all records if none or all of them are suspected
+	static const vector<Ptr<ServiceRegistryRecord> > & GetLiveRecords (const vector<Ptr<ServiceRegistryRecord> > & records)
+	{
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator 	it;
+
+
+		for (it = records.begin(); it != records.end(); it++)
+		{
+			if ((*it)->IsSuspected())
+			{
+				break;
+			}
+		}
+
+		// common case - nothing to exclude, no copy
+		if (it == records.end())
+		{
+			return records;
+		}
+
+		s_liveRecords.clear();
+
+		for (it = records.begin(); it != records.end(); it++)
+		{
+			if (!(*it)->IsSuspected())
+			{
+				s_liveRecords.push_back(*it);
+			}
+		}
+
+		if (s_liveRecords.empty())
+		{
+			return records;
+		}
+
+		return s_liveRecords;
+	}
+
+public:
+
+	static void WriteOut()
+	{
+		map <uint32_t, Ptr<ServiceRegistryRecord> >::iterator 			rit;
+		Ptr<ServiceRegistryRecord>										record;
+
+
+		NS_LOG_UNCOND("Service registry state ...");
+		NS_LOG_UNCOND("	# of records: " << s_serviceRecords.size());
+
+		for (rit=s_serviceRecords.begin() ; rit != s_serviceRecords.end(); rit++ )
+		{
+			record = rit->second;
+		 	NS_LOG_UNCOND("Service: " << record->GetService()->GetServiceId()
+					<< ", contract: " << record->GetService()->GetContractId()
+					<< ", node: " << record->GetNodeId()
+					<< ", address: " << record->GetServiceAddress());
+		}
+
+		NS_LOG_UNCOND("End of service registry state");
+	}
+
+}; // ServiceRegistry
+
+map<uint32_t, Ptr<ServiceRegistryRecord> > 				ServiceRegistry::s_serviceRecords;
+vector<vector<Ptr<ServiceRegistryRecord> > > 			ServiceRegistry::s_contractRecords;
+const vector<Ptr<ServiceRegistryRecord> >				ServiceRegistry::s_noRecords;
+vector<ServiceRegistry::ContractLoad>					ServiceRegistry::s_contractLoads;
+vector<ServiceRegistry::ResponseTimeWindow>				ServiceRegistry::s_responseTimeWindows;
+vector<Time>											ServiceRegistry::s_sortedResponseTimes;
+Ptr<ServiceRegistryServiceSelector>						ServiceRegistry::s_serviceSelector;
+vector<Ptr<ServiceRegistryRecord> >						ServiceRegistry::s_liveRecords;
+uint32_t												ServiceRegistry::s_suspicionThreshold = 0;
+Time													ServiceRegistry::s_suspicionPeriod = Seconds(0);
+bool													ServiceRegistry::s_isDiscoveryEnabled = false;
+map<uint32_t, Ptr<ServiceDiscoveryAgent> >				ServiceRegistry::s_discoveryAgents;
+uint32_t												ServiceRegistry::s_numberOfDeregistrations = 0;
+uint32_t												ServiceRegistry::s_numberOfSuspicions = 0;
+uint32_t												ServiceRegistry::s_numberOfRequestsToDeadServices = 0;
+Time													ServiceRegistry::s_timeWastedOnDeadServices = Seconds(0);
+
+
+/*
+ * Processing capacity of a node - work demands (ms of a single core) of services running on the node
+ * share the cores, co-located services slow each other down
+ * */
+class NodeCpu : public Object
+{
+protected:
+	const uint32_t					m_cores;
+	uint32_t						m_lastJobId;
+
+private:
+	// busy core time integral - ms
+	double							m_busyCoreTime;
+	uint32_t						m_busyCores;
+	Time							m_lastBusyUpdate;
+
+public:
+
+	NodeCpu (uint32_t cores)
+	:m_cores(cores),
+	 m_lastJobId(0),
+	 m_busyCoreTime(0),
+	 m_busyCores(0)
+	{
+		NS_ASSERT(cores > 0);
+	}
+
+	virtual ~NodeCpu ()
+	{}
+
+	// returns id of the job - onFinished is called when the work is done
+	virtual uint32_t SubmitWork (double work, Callback<void> onFinished) = 0;
+	virtual void CancelWork (uint32_t jobId) = 0;
+
+	double GetBusyCoreTime () const { return m_busyCoreTime; }
+	uint32_t GetCores () const { return m_cores; }
+
+	// busy time since the last change of busy cores is accounted - at the end of the run
+	void FlushBusyCoreTime ()
+	{
+		UpdateBusyCores(m_busyCores);
+	}
+
+protected:
+
+	void UpdateBusyCores (uint32_t busyCores)
+	{
+		m_busyCoreTime += m_busyCores * (Simulator::Now() - m_lastBusyUpdate).GetSeconds() * 1000;
+		m_busyCores = busyCores;
+		m_lastBusyUpdate = Simulator::Now();
+	}
+
+}; // NodeCpu
+
+
+// all jobs progress at once, each at the rate of min(1, cores / jobs)
+class NodeCpuProcessorSharing : public NodeCpu
+{
+private:
+
+	struct Job
+	{
+		uint32_t			jobId;
+		double				remainingWork; // ms
+		Callback<void>		onFinished;
+	};
+
+	list<Job>						m_jobs;
+	Time							m_lastAdvance;
+	EventId							m_finishEvent;
+
+public:
+
+	NodeCpuProcessorSharing (uint32_t cores)
+	:NodeCpu(cores)
+	{}
+
+	virtual ~NodeCpuProcessorSharing ()
+	{
+		m_finishEvent.Cancel();
+	}
+
+	virtual uint32_t SubmitWork (double work, Callback<void> onFinished)
+	{
+		Job 		job;
+
+
+		Advance();
+
+		job.jobId = ++m_lastJobId;
+		job.remainingWork = work;
+		job.onFinished = onFinished;
+		m_jobs.push_back(job);
+
+		Reschedule();
+
+		return job.jobId;
+	}
+
+	virtual void CancelWork (uint32_t jobId)
+	{
+		list<Job>::iterator			it;
+
+
+		Advance();
+
+		for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+		{
+			if (it->jobId == jobId)
+			{
+				m_jobs.erase(it);
+				break;
+			}
+		}
+
+		Reschedule();
+	}
+
+private:
+
+	double GetRate () const
+	{
+		if (m_jobs.empty())
+		{
+			return 0;
+		}
+
+		return min(1.0, (double) m_cores / m_jobs.size());
+	}
+
+	// work done since the last change of jobs
+	void Advance ()
+	{
+		list<Job>::iterator			it;
+		double						work = (Simulator::Now() - m_lastAdvance).GetSeconds() * 1000 * GetRate();
+
+
+		for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+		{
+			it->remainingWork -= work;
+		}
+
+		m_lastAdvance = Simulator::Now();
+	}
+
+	void Reschedule ()
+	{
+		list<Job>::iterator			it;
+		double						minRemainingWork = -1;
+
+
+		m_finishEvent.Cancel();
+		UpdateBusyCores(min(m_cores, (uint32_t) m_jobs.size()));
+
+		if (m_jobs.empty())
+		{
+			return;
+		}
+
+		for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+		{
+			if (minRemainingWork < 0 || it->remainingWork < minRemainingWork)
+			{
+				minRemainingWork = it->remainingWork;
+			}
+		}
+
+		m_finishEvent = Simulator::Schedule (
+				Seconds(max(0.0, minRemainingWork) / GetRate() / 1000),
+				&NodeCpuProcessorSharing::OnJobsFinished,
+				this);
+	}
+
+	void OnJobsFinished ()
+	{
+		list<Job>::iterator			it;
+		vector<Callback<void> >		finished;
+
+
+		Advance();
+
+		it = m_jobs.begin();
+
+		while (it != m_jobs.end())
+		{
+			// rounding of the event time
+			if (it->remainingWork <= 1e-6)
+			{
+				finished.push_back(it->onFinished);
+				it = m_jobs.erase(it);
+				continue;
+			}
+
+			it++;
+		}
+
+		Reschedule();
+
+		// state is consistent - callbacks may submit new work
+		for (uint32_t i = 0; i < finished.size(); i++)
+		{
+			finished[i]();
+		}
+	}
+
+}; // NodeCpuProcessorSharing
+
+
+// jobs run to completion on one core each, in order of arrival
+class NodeCpuMultiCoreFcfs : public NodeCpu
+{
+private:
+
+	struct Job
+	{
+		uint32_t			jobId;
+		double				work; // ms
+		Callback<void>		onFinished;
+		EventId				finishEvent;
+	};
+
+	list<Job>						m_runningJobs;
+	list<Job>						m_waitingJobs;
+
+public:
+
+	NodeCpuMultiCoreFcfs (uint32_t cores)
+	:NodeCpu(cores)
+	{}
+
+	virtual ~NodeCpuMultiCoreFcfs ()
+	{
+		list<Job>::iterator			it;
+
+
+		for (it = m_runningJobs.begin(); it != m_runningJobs.end(); it++)
+		{
+			it->finishEvent.Cancel();
+		}
+	}
+
+	virtual uint32_t SubmitWork (double work, Callback<void> onFinished)
+	{
+		Job 		job;
+
+
+		job.jobId = ++m_lastJobId;
+		job.work = work;
+		job.onFinished = onFinished;
+
+		if (m_runningJobs.size() < m_cores)
+		{
+			StartJob(job);
+		}
+		else
+		{
+			m_waitingJobs.push_back(job);
+		}
+
+		return job.jobId;
+	}
+
+	virtual void CancelWork (uint32_t jobId)
+	{
+		list<Job>::iterator			it;
+
+
+		for (it = m_waitingJobs.begin(); it != m_waitingJobs.end(); it++)
+		{
+			if (it->jobId == jobId)
+			{
+				m_waitingJobs.erase(it);
+				return;
+			}
+		}
+
+		for (it = m_runningJobs.begin(); it != m_runningJobs.end(); it++)
+		{
+			if (it->jobId == jobId)
+			{
+				it->finishEvent.Cancel();
+				m_runningJobs.erase(it);
+				StartWaitingJob();
+				return;
+			}
+		}
+	}
+
+private:
+
+	void StartJob (Job job)
+	{
+		job.finishEvent = Simulator::Schedule (
+				Seconds(job.work / 1000),
+				&NodeCpuMultiCoreFcfs::OnJobFinished,
+				this,
+				job.jobId);
+
+		m_runningJobs.push_back(job);
+		UpdateBusyCores(m_runningJobs.size());
+	}
+
+	void StartWaitingJob ()
+	{
+		if (!m_waitingJobs.empty())
+		{
+			StartJob(m_waitingJobs.front());
+			m_waitingJobs.pop_front();
+		}
+		else
+		{
+			UpdateBusyCores(m_runningJobs.size());
+		}
+	}
+
+	void OnJobFinished (uint32_t jobId)
+	{
+		list<Job>::iterator			it;
+		Callback<void>				onFinished;
+
+
+		for (it = m_runningJobs.begin(); it != m_runningJobs.end(); it++)
+		{
+			if (it->jobId == jobId)
+			{
+				onFinished = it->onFinished;
+				m_runningJobs.erase(it);
+				break;
+			}
+		}
+
+		StartWaitingJob();
+
+		if (!onFinished.IsNull())
+		{
+			onFinished();
+		}
+	}
+
+}; // NodeCpuMultiCoreFcfs
+
+
+class NodeCpuRegistry
+{
+public:
+
+	enum Scheduling
+	{
+		ProcessorSharing,
+		MultiCoreFcfs
+	};
+
+private:
+
+	static bool									s_isEnabled;
+	static uint32_t								s_cores;
+	static Scheduling							s_scheduling;
+	// key is nodeId
+	static map<uint32_t, Ptr<NodeCpu> >			s_nodeCpus;
+
+public:
+
+	static void Enable (uint32_t cores, Scheduling scheduling)
+	{
+		NS_ASSERT(cores > 0);
+
+		s_isEnabled = true;
+		s_cores = cores;
+		s_scheduling = scheduling;
+	}
+
+	static bool IsEnabled () { return s_isEnabled; }
+
+	// null if node cpus are disabled - processing delays are independent waits
+	static Ptr<NodeCpu> GetNodeCpu (Ptr<Node> node)
+	{
+		map<uint32_t, Ptr<NodeCpu> >::iterator		it;
+		Ptr<NodeCpu>								cpu;
+
+
+		if (!s_isEnabled)
+		{
+			return NULL;
+		}
+
+		it = s_nodeCpus.find(node->GetId());
+
+		if (it != s_nodeCpus.end())
+		{
+			return it->second;
+		}
+
+		if (s_scheduling == ProcessorSharing)
+		{
+			cpu = CreateObject<NodeCpuProcessorSharing>(s_cores);
+		}
+		else
+		{
+			cpu = CreateObject<NodeCpuMultiCoreFcfs>(s_cores);
+		}
+
+		s_nodeCpus.insert(make_pair(node->GetId(), cpu));
+
+		return cpu;
+	}
+
+	// called before the simulator is destroyed - the run time is lost afterwards
+	static void FlushUtilization ()
+	{
+		map<uint32_t, Ptr<NodeCpu> >::iterator		it;
+
+
+		for (it = s_nodeCpus.begin(); it != s_nodeCpus.end(); it++)
+		{
+			it->second->FlushBusyCoreTime();
+		}
+	}
+
+	static void WriteOutUtilization (Time runLength)
+	{
+		map<uint32_t, Ptr<NodeCpu> >::iterator		it;
+
+
+		for (it = s_nodeCpus.begin(); it != s_nodeCpus.end(); it++)
+		{
+			NS_LOG_UNCOND("		Node: " << it->first
+					<< ", cores: " << it->second->GetCores()
+					<< ", utilization: " << it->second->GetBusyCoreTime() / (it->second->GetCores() * runLength.GetSeconds() * 1000));
+		}
+	}
+
+}; // NodeCpuRegistry
+
+bool									NodeCpuRegistry::s_isEnabled = false;
+uint32_t								NodeCpuRegistry::s_cores = 1;
+NodeCpuRegistry::Scheduling				NodeCpuRegistry::s_scheduling = NodeCpuRegistry::ProcessorSharing;
+map<uint32_t, Ptr<NodeCpu> >			NodeCpuRegistry::s_nodeCpus;
+
+
+/*
+ * Cancellation of work of a service instance
+ * 		Shared by the instance with its tasks and their executers - once cancelled, no further work
+ * 		(step, request, processing) is started by any of them, even from events already scheduled.
+ */
+class CancellationToken : public Object
+{
+private:
+	bool				m_isCancelled;
+
+public:
+
+	CancellationToken ()
+		:m_isCancelled (false)
+	{}
+
+	virtual ~CancellationToken() {}
+
+	void Cancel () { m_isCancelled = true; }
+	bool IsCancelled () const { return m_isCancelled; }
+
+}; // CancellationToken
+
+
+/*
+ * One call of a parallel step group (or the hedge copy of a hedged step)
+ * 		Each call owns its client endpoint, so calls of the group are outstanding concurrently.
+ * 		The outstanding call is accounted in the registry like the sequential request of the executer.
+ * 		The executer is notified only once - about success or failure of the call.
+ */
+class ExecutionGroupRequest : public Object
+{
+private:
+	const Ptr<Node> 					m_node;
+	const Ptr<ServiceBase>				m_serviceBase;
+	const Ptr<SimulationOutput> 		m_simulationOutput;
+	const Ptr<ServiceRegistryRecord>	m_record;
+	Callback<void, bool>				m_onCompleted;
+	Ptr<ClientMessageEndpoint>			m_clientEndpoint;
+	Time								m_startTime;
+	bool								m_isOutstanding;
+	bool								m_isRecordingExceptions;
+	// null until responded
+	Ptr<Message>						m_response;
+	bool								m_isSendFailed;
+
+public:
+
+	ExecutionGroupRequest (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ServiceRegistryRecord> record,
+			Callback<void, bool> onCompleted,
+			bool isRecordingExceptions = true)
+			:m_node(node),
+			 m_serviceBase(serviceBase),
+			 m_simulationOutput(simulationOutput),
+			 m_record(record),
+			 m_onCompleted(onCompleted),
+			 m_isOutstanding(false),
+			 m_isRecordingExceptions(isRecordingExceptions),
+			 m_isSendFailed(false)
+	{
+		NS_ASSERT(node != NULL);
+		NS_ASSERT(serviceBase != NULL);
+		NS_ASSERT(simulationOutput != NULL);
+		NS_ASSERT(record != NULL);
+		NS_ASSERT(!onCompleted.IsNull());
+
+		m_clientEndpoint = MessageEndpointFactory::CreateClientMessageEndpoint(
+				m_node,
+				m_serviceBase,
+				m_simulationOutput,
+				MakeCallback(&ExecutionGroupRequest::OnSendSuccess, this),
+				MakeCallback(&ExecutionGroupRequest::OnSendFailure, this),
+				MakeCallback(&ExecutionGroupRequest::OnReceiveResponse, this),
+				MakeCallback(&ExecutionGroupRequest::OnResponseTimeout, this));
+
+		m_clientEndpoint->Open();
+	}
+
+	virtual ~ExecutionGroupRequest()
+	{
+		Cancel();
+	}
+
+	bool IsOutstanding () const { return m_isOutstanding; }
+	Ptr<Message> GetResponse () const { return m_response; }
+	bool IsSendFailed () const { return m_isSendFailed; }
+
+	void Send (Ptr<Message> msg)
+	{
+		NS_ASSERT(msg != NULL);
+		NS_ASSERT(m_clientEndpoint != NULL);
+		NS_ASSERT(!m_isOutstanding);
+
+		// accounted before sending - failure may be reported while sending
+		m_isOutstanding = true;
+		m_response = NULL;
+		m_isSendFailed = false;
+		m_startTime = Simulator::Now();
+		ServiceRegistry::OnRequestStarted(m_node, m_record);
+
+		m_clientEndpoint->SendMessage(msg, m_record->GetServiceAddress(), true);
+	}
+
+	// the call is abandoned - the executer is not notified
+	void Cancel ()
+	{
+		if (m_isOutstanding)
+		{
+			m_isOutstanding = false;
+			ServiceRegistry::OnRequestCancelled(m_node, m_record, m_startTime);
+		}
+
+		if (m_clientEndpoint != NULL)
+		{
+			m_clientEndpoint->Close();
+			m_clientEndpoint = NULL;
+		}
+	}
+
+private:
+
+	void OnSendSuccess ()
+	{}
+
+	void OnSendFailure ()
+	{
+		m_isSendFailed = true;
+		Complete(false, false);
+	}
+
+	void OnReceiveResponse (Ptr<Message> msg)
+	{
+		NS_ASSERT(msg != NULL);
+
+		if (msg->GetMessageType() == Message::MTResponseException && m_isRecordingExceptions)
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_RECEIVED_EXCEPTION, msg);
+		}
+
+		m_response = msg;
+		Complete(msg->GetMessageType() != Message::MTResponseException, true);
+	}
+
+	void OnResponseTimeout ()
+	{
+		Complete(false, false);
+	}
+
+	void Complete (bool success, bool responded)
+	{
+		if (!m_isOutstanding)
+		{
+			return;
+		}
+
+		m_isOutstanding = false;
+
+		ServiceRegistry::OnRequestCompleted(
+				m_node,
+				m_record,
+				success,
+				responded,
+				Simulator::Now() - m_startTime);
+
+		m_onCompleted(success);
+	}
+
+}; // ExecutionGroupRequest
+
+
+/*
+ * Request shared by executers of one node (single flight)
+ * 		Executers of service tasks calling the same contract method concurrently are coalesced - the
+ * 		first one sends the request, later ones attach to it while it is outstanding and all of them
+ * 		are notified about its single outcome. The request is abandoned once all callers detach.
+ */
+class CoalescedRequest : public Object
+{
+private:
+	const uint32_t										m_nodeId;
+	const uint64_t										m_key;
+	Ptr<ExecutionGroupRequest>							m_request;
+	Ptr<Message>										m_msg;
+	// key is waiter id
+	map<uint32_t, Callback<void, bool> >				m_waiters;
+
+	static bool											s_isEnabled;
+	static uint32_t										s_waiterCounter;
+	// outstanding requests - key is nodeId, key of inner map is the coalescing key
+	static map<uint32_t, map<uint64_t, Ptr<CoalescedRequest> > >		s_requests;
+	static uint32_t										s_numberOfRequests;
+	static uint32_t										s_numberOfCoalescedCalls;
+
+public:
+
+	CoalescedRequest (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ServiceRegistryRecord> record,
+			uint64_t key)
+		:m_nodeId (node->GetId()),
+		 m_key (key)
+	{
+		// received exceptions are recorded by the callers
+		m_request = CreateObject<ExecutionGroupRequest>(
+				node,
+				serviceBase,
+				simulationOutput,
+				record,
+				MakeCallback(&CoalescedRequest::OnCompleted, this),
+				false);
+	}
+
+	virtual ~CoalescedRequest() {}
+
+	static void Enable () { s_isEnabled = true; }
+	static bool IsEnabled () { return s_isEnabled; }
+
+	// calls of the same contract method share the key
+	static uint64_t GetKey (uint32_t contractId, uint32_t contractMethodId)
+	{
+		return ((uint64_t)contractId << 32) | contractMethodId;
+	}
+
+	// null if no request of the key is outstanding on the node
+	static Ptr<CoalescedRequest> Find (Ptr<Node> node, uint64_t key)
+	{
+		map<uint32_t, map<uint64_t, Ptr<CoalescedRequest> > >::iterator		nit = s_requests.find(node->GetId());
+		map<uint64_t, Ptr<CoalescedRequest> >::iterator						it;
+
+
+		if (nit == s_requests.end())
+		{
+			return NULL;
+		}
+
+		it = nit->second.find(key);
+
+		if (it == nit->second.end())
+		{
+			return NULL;
+		}
+
+		return it->second;
+	}
+
+	// outstanding once sent - callers attach before sending
+	static Ptr<CoalescedRequest> Create (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ServiceRegistryRecord> record,
+			uint64_t key)
+	{
+		Ptr<CoalescedRequest>		request = CreateObject<CoalescedRequest>(node, serviceBase, simulationOutput, record, key);
+
+
+		NS_ASSERT(Find(node, key) == NULL);
+
+		s_requests[node->GetId()][key] = request;
+		s_numberOfRequests++;
+
+		return request;
+	}
+
+	uint32_t Attach (Callback<void, bool> onCompleted)
+	{
+		NS_ASSERT(!onCompleted.IsNull());
+
+		// callers attached to the sent request do not send their own
+		if (m_request->IsOutstanding())
+		{
+			s_numberOfCoalescedCalls++;
+		}
+
+		s_waiterCounter++;
+		m_waiters.insert(make_pair(s_waiterCounter, onCompleted));
+
+		return s_waiterCounter;
+	}
+
+	// the last caller detached - request is not needed any more
+	void Detach (uint32_t waiterId)
+	{
+		m_waiters.erase(waiterId);
+
+		if (m_waiters.empty() && m_request->IsOutstanding())
+		{
+			m_request->Cancel();
+			Remove();
+		}
+	}
+
+	void Send (Ptr<Message> msg)
+	{
+		m_msg = msg;
+		m_request->Send(msg);
+	}
+
+	// the request carries the sender's deadline - callers awaiting longer are not served by it
+	bool CanServe (Ptr<Message> conversationMsg) const
+	{
+		NS_ASSERT(conversationMsg != NULL);
+
+		if (m_msg == NULL || !m_msg->HasDeadline())
+		{
+			return true;
+		}
+
+		return conversationMsg->HasDeadline() && conversationMsg->GetDeadline() <= m_msg->GetDeadline();
+	}
+
+	// null if not responded
+	Ptr<Message> GetResponse () const { return m_request->GetResponse(); }
+	bool IsSendFailed () const { return m_request->IsSendFailed(); }
+
+	static uint32_t GetNumberOfRequests () { return s_numberOfRequests; }
+	static uint32_t GetNumberOfCoalescedCalls () { return s_numberOfCoalescedCalls; }
+
+	// requests outstanding at the end of the run are cancelled - released before the simulator is destroyed
+	static void Clear ()
+	{
+		map<uint32_t, map<uint64_t, Ptr<CoalescedRequest> > >::iterator		nit;
+		map<uint64_t, Ptr<CoalescedRequest> >::iterator						it;
+
+
+		for (nit = s_requests.begin(); nit != s_requests.end(); nit++)
+		{
+			for (it = nit->second.begin(); it != nit->second.end(); it++)
+			{
+				it->second->m_waiters.clear();
+
+				if (it->second->m_request->IsOutstanding())
+				{
+					it->second->m_request->Cancel();
+				}
+			}
+		}
+
+		s_requests.clear();
+	}
+
+private:
+
+	void OnCompleted (bool success)
+	{
+		map<uint32_t, Callback<void, bool> >				waiters;
+		map<uint32_t, Callback<void, bool> >::iterator		it;
+
+
+		// later calls send a new request
+		Remove();
+
+		waiters.swap(m_waiters);
+
+		for (it = waiters.begin(); it != waiters.end(); it++)
+		{
+			it->second(success);
+		}
+	}
+
+	void Remove ()
+	{
+		map<uint64_t, Ptr<CoalescedRequest> > &				requests = s_requests[m_nodeId];
+		map<uint64_t, Ptr<CoalescedRequest> >::iterator		it = requests.find(m_key);
+
+
+		if (it != requests.end() && it->second == this)
+		{
+			requests.erase(it);
+		}
+	}
+
+}; // CoalescedRequest
+
+bool												CoalescedRequest::s_isEnabled = false;
+uint32_t											CoalescedRequest::s_waiterCounter = 0;
+map<uint32_t, map<uint64_t, Ptr<CoalescedRequest> > >		CoalescedRequest::s_requests;
+uint32_t											CoalescedRequest::s_numberOfRequests = 0;
+uint32_t											CoalescedRequest::s_numberOfCoalescedCalls = 0;
+
+
+class ExecutionPlanExecuter : public Object, public InstanceCounter
+{
+private:
+	// outcome of the primary request of a hedged step
+	enum RequestOutcome
+	{
+		OutcomeNone,
+		OutcomeSendFailure,
+		OutcomeResponse,
+		OutcomeResponseTimeout
+	};
+
+	// not const - executers of service tasks are reused (see ServiceTaskManager)
+	Ptr<Node> 							m_node;
+	Ptr<Message>						m_conversationMsg;
+	Ptr<ExecutionPlan>					m_plan;
+	Ptr<ClientMessageEndpoint>			m_clientEndpoint;
+	EventId								m_executeTaskEvent;
+	// job on the node cpu - 0 if none
+	uint32_t							m_cpuJobId;
+	// destination of the outstanding request - null if none
+	Ptr<ServiceRegistryRecord>			m_requestRecord;
+	Time								m_requestStartTime;
+	// null if the executer is not cancelled from outside
+	Ptr<CancellationToken>				m_cancellationToken;
+	// parallel step group in progress - calls of the latest group are kept until the next group
+	vector<Ptr<ExecutionGroupRequest> >	m_groupRequests;
+	uint32_t							m_groupId;
+	uint32_t							m_groupSize;
+	uint32_t							m_groupRequired;
+	uint32_t							m_groupSucceeded;
+	uint32_t							m_groupFailed;
+	Time								m_groupStartTime;
+	bool								m_isGroupActive;
+	bool								m_isGroupIssuing;
+	// hedged step in progress - the primary request is the sequential request of the executer,
+	// the hedge request of the latest hedged step is kept until the next hedged step
+	vector<Ptr<ServiceRegistryRecord> >	m_hedgeCandidates;
+	Ptr<ExecutionGroupRequest>			m_hedgeRequest;
+	EventId								m_hedgeEvent;
+	uint32_t							m_hedgeStep;
+	Time								m_hedgeDelay;
+	Time								m_hedgeStartTime;
+	bool								m_isHedgeActive;
+	bool								m_isHedgeSent;
+	// failed primary request - its outcome is kept until the hedge request is decided
+	RequestOutcome						m_heldOutcome;
+	Ptr<Message>						m_heldResponse;
+	// coalesced request awaited by the step in progress - kept until the next coalesced step
+	Ptr<CoalescedRequest>				m_coalescedRequest;
+	uint32_t							m_coalescedWaiterId;
+	bool								m_isCoalescedWaiting;
+	// the request was sent by this executer - its response belongs to the own conversation
+	bool								m_isCoalescedSender;
+
+	static uint32_t						s_groupCounter;
+	static uint32_t						s_joinedGroupCounter;
+	static uint32_t						s_abandonedGroupRequestCounter;
+	static Time							s_groupLatency;
+	static uint32_t						s_hedgedStepCounter;
+	static uint32_t						s_hedgeRequestCounter;
+	static uint32_t						s_hedgeWinCounter;
+	static uint32_t						s_abandonedHedgedRequestCounter;
+	static Time							s_hedgedStepLatency;
+	static Time							s_hedgeWinLatency;
+
+protected:
+	Ptr<ServiceBase>					m_serviceBase;
+	Ptr<SimulationOutput> 				m_simulationOutput;
+
+public:
+
+	ExecutionPlanExecuter (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<Message> conversationMsg,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ExecutionPlan> plan)
+			:InstanceCounter(typeid(this).name()),
+			 m_node(node),
+			 m_conversationMsg(conversationMsg),
+			 m_plan (plan),
+			 m_cpuJobId (0),
+			 m_groupId (0),
+			 m_groupSize (0),
+			 m_groupRequired (0),
+			 m_groupSucceeded (0),
+			 m_groupFailed (0),
+			 m_isGroupActive (false),
+			 m_isGroupIssuing (false),
+			 m_hedgeStep (0),
+			 m_isHedgeActive (false),
+			 m_isHedgeSent (false),
+			 m_heldOutcome (OutcomeNone),
+			 m_coalescedWaiterId (0),
+			 m_isCoalescedWaiting (false),
+			 m_isCoalescedSender (false),
+			 m_serviceBase(serviceBase),
+			 m_simulationOutput(simulationOutput)
+	{
+		// conversationMsg - can be null
+		NS_ASSERT(node != NULL);
+		NS_ASSERT(serviceBase != 0);
+		NS_ASSERT(simulationOutput != NULL);
+		NS_ASSERT(plan != NULL);
+	}
+
+	virtual ~ExecutionPlanExecuter()
+	{
+		Stop();
+	}
+
+	void SetCancellationToken (Ptr<CancellationToken> cancellationToken)
+	{
+		m_cancellationToken = cancellationToken;
+	}
+
+	bool IsCancelled () const
+	{
+		return m_cancellationToken != NULL && m_cancellationToken->IsCancelled();
+	}
+
+	// client of the conversation does not await its response any more
+	bool IsConversationDeadlineExpired () const
+	{
+		return m_conversationMsg != NULL && m_conversationMsg->IsDeadlineExpired();
+	}
+
+	Ptr<Message> GetConversationMessage () const { return m_conversationMsg; }
+
+	void Start ()
+	{
+		NS_ASSERT(m_clientEndpoint == NULL);
+
+		if (IsCancelled())
+		{
+			return;
+		}
+
+		m_clientEndpoint = MessageEndpointFactory::CreateClientMessageEndpoint(
+				m_node,
+				m_serviceBase,
+				m_simulationOutput,
+				MakeCallback(&ExecutionPlanExecuter::OnRequestSendSuccess, this),
+				MakeCallback(&ExecutionPlanExecuter::OnRequestSendFailure, this),
+				MakeCallback(&ExecutionPlanExecuter::OnRequestReceiveResponse, this),
+				MakeCallback(&ExecutionPlanExecuter::OnRequestResponseTimeout, this));
+
+		m_clientEndpoint->Open();
+
+		OnStart();
+	}
+
+	void Stop ()
+	{
+		m_executeTaskEvent.Cancel();
+
+		if (m_cpuJobId != 0)
+		{
+			NodeCpuRegistry::GetNodeCpu(m_node)->CancelWork(m_cpuJobId);
+			m_cpuJobId = 0;
+		}
+
+		if (m_requestRecord != NULL)
+		{
+			ServiceRegistry::OnRequestCancelled(m_node, m_requestRecord, m_requestStartTime);
+			m_requestRecord = NULL;
+		}
+
+		m_isGroupActive = false;
+		ReleaseGroupRequests();
+
+		m_hedgeEvent.Cancel();
+		m_isHedgeActive = false;
+		m_heldOutcome = OutcomeNone;
+		m_heldResponse = NULL;
+
+		if (m_hedgeRequest != NULL)
+		{
+			m_hedgeRequest->Cancel();
+		}
+
+		if (m_isCoalescedWaiting)
+		{
+			m_isCoalescedWaiting = false;
+			m_coalescedRequest->Detach(m_coalescedWaiterId);
+		}
+
+		if(m_clientEndpoint != NULL)
+		{
+			m_clientEndpoint->Close();
+			m_clientEndpoint = NULL;
+		}
+
+		OnStop();
+	}
+
+protected:
+
+	// stopped executer - new conversation with the same or other plan
+	void Reinitialize (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<Message> conversationMsg,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ExecutionPlan> plan)
+	{
+		NS_ASSERT(node != NULL);
+		NS_ASSERT(serviceBase != 0);
+		NS_ASSERT(simulationOutput != NULL);
+		NS_ASSERT(plan != NULL);
+		NS_ASSERT(m_clientEndpoint == NULL);
+		NS_ASSERT(m_requestRecord == NULL);
+		NS_ASSERT(m_cpuJobId == 0);
+		NS_ASSERT(!m_isGroupActive);
+		NS_ASSERT(!m_isHedgeActive);
+		NS_ASSERT(!m_isCoalescedWaiting);
+
+		ReleaseGroupRequests();
+		m_hedgeRequest = NULL;
+		m_coalescedRequest = NULL;
+
+		m_node = node;
+		m_serviceBase = serviceBase;
+		m_conversationMsg = conversationMsg;
+		m_simulationOutput = simulationOutput;
+		m_plan = plan;
+	}
+
+	virtual void OnStart() = 0;
+	// events scheduled by derived executers are cancelled
+	virtual void OnStop() {}
+	virtual void ExecuteNextStep () = 0;
+	virtual void Request_onSendSuccessCallback() = 0;
+	virtual void Request_onSendFailureCallback() = 0;
+	virtual void Request_onReceiveResponseCallback(Ptr<Message> msg) = 0;
+	virtual void Request_onResponseTimeoutCallback() = 0;
+	virtual void Group_onFinishedCallback(bool joined) = 0;
+
+	void ExecuteNextStepWithDelay (const RandomVariable & delay)
+	{
+		Time			delayValue = MilliSeconds(delay.GetInteger());
+
+		m_executeTaskEvent = Simulator::Schedule (delayValue, &ExecutionPlanExecuter::ContinueExecution, this);
+	}
+
+	// processing on the node - work demand on the node cpu (if enabled), otherwise a delay
+	void ExecuteNextStepAfterWork (const RandomVariable & workDemand)
+	{
+		Ptr<NodeCpu>		cpu = NodeCpuRegistry::GetNodeCpu(m_node);
+
+
+		if (cpu == NULL)
+		{
+			ExecuteNextStepWithDelay(workDemand);
+			return;
+		}
+
+		NS_ASSERT(m_cpuJobId == 0);
+
+		m_cpuJobId = cpu->SubmitWork(
+				workDemand.GetInteger(),
+				MakeCallback(&ExecutionPlanExecuter::OnWorkFinished, this));
+	}
+
+	void ExecuteSendMessage (uint32_t index)
+	{
+		NS_ASSERT(index < m_plan->GetExecutionStepsCount());
+
+		uint32_t 						contractId = m_plan->GetStepContractId(index);
+		uint32_t 						contractMethodId = m_plan->GetStepContractMethodId(index);
+		Ptr<ServiceRegistryRecord> 		registryRecord;
+		uint32_t						size = m_plan->GetStepRequestSize(index).GetInteger();
+
+
+		NS_ASSERT(m_requestRecord == NULL);
+		NS_ASSERT(!m_isHedgeActive);
+
+		// calls of service tasks (conversation in progress) are coalesced on the node
+		if (CoalescedRequest::IsEnabled() && m_conversationMsg != NULL && !m_plan->IsStepHedged(index)
+				&& ExecuteSendCoalesced(index))
+		{
+			return;
+		}
+
+		if (m_plan->IsStepHedged(index))
+		{
+			FindRequestDestinations(contractId, 2);
+
+			if (!m_hedgeCandidates.empty())
+			{
+				registryRecord = m_hedgeCandidates[0];
+			}
+		}
+		else
+		{
+			registryRecord = FindRequestDestination(contractId);
+		}
+
+		// all services of the contract stopped
+		if (registryRecord == NULL)
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_SERVICE_NOT_FOUND, m_conversationMsg, "no registered service of the contract");
+			Request_onSendFailureCallback();
+			return;
+		}
+
+		// destination known to fail - no network traffic, no waiting for timeouts
+		if (!CircuitBreakerRegistry::AllowRequest(m_node, registryRecord))
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_CIRCUIT_OPEN, m_conversationMsg, "circuit breaker of the destination open");
+			Request_onSendFailureCallback();
+			return;
+		}
+
+		// accounted before sending - failure may be reported while sending
+		m_requestRecord = registryRecord;
+		m_requestStartTime = Simulator::Now();
+		ServiceRegistry::OnRequestStarted(m_node, registryRecord);
+
+		// hedge is armed before sending - failure while sending disarms it
+		if (m_plan->IsStepHedged(index) && m_hedgeCandidates.size() > 1)
+		{
+			StartHedge(index);
+		}
+
+		SendMessage(
+				registryRecord->GetNodeId(),
+				registryRecord->GetService()->GetServiceId(),
+				registryRecord->GetServiceAddress(),
+				contractMethodId,
+				size);
+	}
+
+	// attaches to the request of the same contract method outstanding on the node, sends it otherwise -
+	// false if the outstanding request cannot serve the conversation (the step sends its own request)
+	bool ExecuteSendCoalesced (uint32_t index)
+	{
+		uint32_t 						contractId = m_plan->GetStepContractId(index);
+		uint32_t 						contractMethodId = m_plan->GetStepContractMethodId(index);
+		uint64_t						key = CoalescedRequest::GetKey(contractId, contractMethodId);
+		Ptr<CoalescedRequest>			request = CoalescedRequest::Find(m_node, key);
+		Ptr<ServiceRegistryRecord> 		registryRecord;
+
+
+		NS_ASSERT(!m_isCoalescedWaiting);
+
+		if (request != NULL)
+		{
+			if (!request->CanServe(m_conversationMsg))
+			{
+				return false;
+			}
+
+			m_coalescedRequest = request;
+			m_coalescedWaiterId = request->Attach(MakeCallback(&ExecutionPlanExecuter::OnCoalescedRequestCompleted, this));
+			m_isCoalescedWaiting = true;
+			m_isCoalescedSender = false;
+			return true;
+		}
+
+		registryRecord = FindRequestDestination(contractId);
+
+		// all services of the contract stopped
+		if (registryRecord == NULL)
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_SERVICE_NOT_FOUND, m_conversationMsg, "no registered service of the contract");
+			Request_onSendFailureCallback();
+			return true;
+		}
+
+		if (!CircuitBreakerRegistry::AllowRequest(m_node, registryRecord))
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_CIRCUIT_OPEN, m_conversationMsg, "circuit breaker of the destination open");
+			Request_onSendFailureCallback();
+			return true;
+		}
+
+		// attached before sending - failure may be reported while sending
+		m_coalescedRequest = CoalescedRequest::Create(m_node, m_serviceBase, m_simulationOutput, registryRecord, key);
+		m_coalescedWaiterId = m_coalescedRequest->Attach(MakeCallback(&ExecutionPlanExecuter::OnCoalescedRequestCompleted, this));
+		m_isCoalescedWaiting = true;
+		m_isCoalescedSender = true;
+
+		m_coalescedRequest->Send(CreateRequestMessage(
+				registryRecord->GetNodeId(),
+				registryRecord->GetService()->GetServiceId(),
+				contractMethodId,
+				m_plan->GetStepRequestSize(index).GetInteger()));
+
+		return true;
+	}
+
+	// issues calls of the steps concurrently - steps have to be of the same parallel group
+	void ExecuteSendGroup (const vector<uint32_t> & indexes)
+	{
+		NS_ASSERT(!indexes.empty());
+		NS_ASSERT(m_requestRecord == NULL);
+		NS_ASSERT(!m_isGroupActive);
+
+		const ExecutionPlan::GroupJoin		join = m_plan->GetGroupJoin(m_plan->GetStepParallelGroup(indexes[0]));
+		uint32_t							index;
+		Ptr<ServiceRegistryRecord> 			registryRecord;
+		Ptr<ExecutionGroupRequest>			request;
+
+
+		ReleaseGroupRequests();
+
+		m_groupId = m_plan->GetStepParallelGroup(indexes[0]);
+		m_groupSize = indexes.size();
+		m_groupSucceeded = 0;
+		m_groupFailed = 0;
+		m_groupStartTime = Simulator::Now();
+		m_isGroupActive = true;
+		m_isGroupIssuing = true;
+
+		switch (join.policy)
+		{
+			case ExecutionPlan::JoinAll: m_groupRequired = m_groupSize; break;
+			case ExecutionPlan::JoinFirstSuccess: m_groupRequired = 1; break;
+			case ExecutionPlan::JoinKOfN: m_groupRequired = min(join.k, m_groupSize); break;
+		}
+
+		s_groupCounter++;
+
+		for (uint32_t i = 0; i < indexes.size(); i++)
+		{
+			index = indexes[i];
+
+			NS_ASSERT(index < m_plan->GetExecutionStepsCount());
+			NS_ASSERT(m_plan->GetStepParallelGroup(index) == m_groupId);
+
+			registryRecord = FindRequestDestination(m_plan->GetStepContractId(index));
+
+			// all services of the contract stopped
+			if (registryRecord == NULL)
+			{
+				m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_SERVICE_NOT_FOUND, m_conversationMsg, "no registered service of the contract");
+				m_groupFailed++;
+				continue;
+			}
+
+			if (!CircuitBreakerRegistry::AllowRequest(m_node, registryRecord))
+			{
+				m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_CIRCUIT_OPEN, m_conversationMsg, "circuit breaker of the destination open");
+				m_groupFailed++;
+				continue;
+			}
+
+			request = CreateObject<ExecutionGroupRequest>(
+					m_node,
+					m_serviceBase,
+					m_simulationOutput,
+					registryRecord,
+					MakeCallback(&ExecutionPlanExecuter::OnGroupRequestCompleted, this));
+
+			m_groupRequests.push_back(request);
+
+			request->Send(CreateRequestMessage(
+					registryRecord->GetNodeId(),
+					registryRecord->GetService()->GetServiceId(),
+					m_plan->GetStepContractMethodId(index),
+					m_plan->GetStepRequestSize(index).GetInteger()));
+		}
+
+		// calls failed while sending are evaluated once all calls are issued
+		m_isGroupIssuing = false;
+		CheckGroupJoin();
+	}
+
+public:
+
+	static uint32_t GetNumberOfGroups () { return s_groupCounter; }
+	static uint32_t GetNumberOfJoinedGroups () { return s_joinedGroupCounter; }
+	static uint32_t GetNumberOfAbandonedGroupRequests () { return s_abandonedGroupRequestCounter; }
+	static Time GetGroupLatency () { return s_groupLatency; }
+	static uint32_t GetNumberOfHedgedSteps () { return s_hedgedStepCounter; }
+	static uint32_t GetNumberOfHedgeRequests () { return s_hedgeRequestCounter; }
+	static uint32_t GetNumberOfHedgeWins () { return s_hedgeWinCounter; }
+	static uint32_t GetNumberOfAbandonedHedgedRequests () { return s_abandonedHedgedRequestCounter; }
+	static Time GetHedgedStepLatency () { return s_hedgedStepLatency; }
+	static Time GetHedgeWinLatency () { return s_hedgeWinLatency; }
+
+private:
+
+	void OnWorkFinished ()
+	{
+		m_cpuJobId = 0;
+		ContinueExecution();
+	}
+
+	void ContinueExecution ()
+	{
+		if (IsCancelled())
+		{
+			Stop();
+			return;
+		}
+
+		ExecuteNextStep();
+	}
+
+	// callbacks of the client endpoint - outstanding request is accounted in the registry
+	// before the executer is notified
+	void OnRequestSendSuccess()
+	{
+		Request_onSendSuccessCallback();
+	}
+
+	void OnRequestSendFailure()
+	{
+		CompleteRequest(false, false);
+
+		if (!HoldOutcomeForHedge(OutcomeSendFailure, NULL))
+		{
+			Request_onSendFailureCallback();
+		}
+	}
+
+	void OnRequestReceiveResponse(Ptr<Message> msg)
+	{
+		NS_ASSERT(msg != NULL);
+
+		bool		success = msg->GetMessageType() != Message::MTResponseException;
+
+
+		CompleteRequest(success, true);
+
+		if (success && m_isHedgeActive)
+		{
+			FinishHedge('p');
+		}
+
+		if (success || !HoldOutcomeForHedge(OutcomeResponse, msg))
+		{
+			Request_onReceiveResponseCallback(msg);
+		}
+	}
+
+	void OnRequestResponseTimeout()
+	{
+		CompleteRequest(false, false);
+
+		if (!HoldOutcomeForHedge(OutcomeResponseTimeout, NULL))
+		{
+			Request_onResponseTimeoutCallback();
+		}
+	}
+
+	void CompleteRequest(bool success, bool responded)
+	{
+		if (m_requestRecord == NULL)
+		{
+			return;
+		}
+
+		ServiceRegistry::OnRequestCompleted(
+				m_node,
+				m_requestRecord,
+				success,
+				responded,
+				Simulator::Now() - m_requestStartTime);
+
+		m_requestRecord = NULL;
+	}
+
+	void OnGroupRequestCompleted (bool success)
+	{
+		if (!m_isGroupActive)
+		{
+			return;
+		}
+
+		if (success)
+		{
+			m_groupSucceeded++;
+		}
+		else
+		{
+			m_groupFailed++;
+		}
+
+		CheckGroupJoin();
+	}
+
+	void CheckGroupJoin ()
+	{
+		if (!m_isGroupActive || m_isGroupIssuing)
+		{
+			return;
+		}
+
+		if (m_groupSucceeded >= m_groupRequired)
+		{
+			FinishGroup(true);
+		}
+		else if (m_groupSize - m_groupFailed < m_groupRequired)
+		{
+			FinishGroup(false);
+		}
+	}
+
+	void FinishGroup (bool joined)
+	{
+		Time		latency = Simulator::Now() - m_groupStartTime;
+
+
+		m_isGroupActive = false;
+
+		// calls still outstanding are not needed by the join any more
+		for (uint32_t i = 0; i < m_groupRequests.size(); i++)
+		{
+			if (m_groupRequests[i]->IsOutstanding())
+			{
+				m_groupRequests[i]->Cancel();
+				s_abandonedGroupRequestCounter++;
+			}
+		}
+
+		s_groupLatency += latency;
+
+		if (joined)
+		{
+			s_joinedGroupCounter++;
+		}
+		else
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_GROUP_JOIN_FAILURE, m_conversationMsg, "join policy of the parallel group not satisfied");
+		}
+
+		m_simulationOutput->RecordGroupJoin(
+				m_serviceBase->GetServiceId(),
+				m_conversationMsg,
+				m_groupId,
+				m_groupSize,
+				m_groupSucceeded,
+				m_groupFailed,
+				joined,
+				latency);
+
+		Group_onFinishedCallback(joined);
+	}
+
+	void StartHedge (uint32_t index)
+	{
+		const ExecutionPlan::StepHedging &		hedging = m_plan->GetStepHedging(index);
+
+
+		m_hedgeStep = index;
+		m_hedgeStartTime = Simulator::Now();
+		m_hedgeDelay = (hedging.percentile > 0)
+				? ServiceRegistry::GetResponseTimePercentile(m_plan->GetStepContractId(index), hedging.percentile, hedging.delay)
+				: hedging.delay;
+		m_isHedgeActive = true;
+		m_isHedgeSent = false;
+		m_heldOutcome = OutcomeNone;
+		m_heldResponse = NULL;
+
+		if (m_hedgeRequest != NULL)
+		{
+			m_hedgeRequest->Cancel();
+			m_hedgeRequest = NULL;
+		}
+
+		s_hedgedStepCounter++;
+
+		m_hedgeEvent = Simulator::Schedule (m_hedgeDelay, &ExecutionPlanExecuter::SendHedgeRequest, this);
+	}
+
+	// primary request not answered within the hedging delay
+	void SendHedgeRequest ()
+	{
+		Ptr<ServiceRegistryRecord>		record = m_hedgeCandidates[1];
+
+
+		NS_ASSERT(m_isHedgeActive);
+		NS_ASSERT(m_requestRecord != NULL);
+
+		if (IsCancelled() || !CircuitBreakerRegistry::AllowRequest(m_node, record))
+		{
+			return;
+		}
+
+		m_hedgeRequest = CreateObject<ExecutionGroupRequest>(
+				m_node,
+				m_serviceBase,
+				m_simulationOutput,
+				record,
+				MakeCallback(&ExecutionPlanExecuter::OnHedgeRequestCompleted, this));
+
+		m_isHedgeSent = true;
+		s_hedgeRequestCounter++;
+
+		m_hedgeRequest->Send(CreateRequestMessage(
+				record->GetNodeId(),
+				record->GetService()->GetServiceId(),
+				m_plan->GetStepContractMethodId(m_hedgeStep),
+				m_plan->GetStepRequestSize(m_hedgeStep).GetInteger()));
+	}
+
+	void OnHedgeRequestCompleted (bool success)
+	{
+		Ptr<Message>		response;
+		RequestOutcome		outcome;
+
+
+		if (!m_isHedgeActive)
+		{
+			return;
+		}
+
+		if (success)
+		{
+			// primary request lost - abandoned, its endpoint is reopened for the next steps
+			if (m_requestRecord != NULL)
+			{
+				ServiceRegistry::OnRequestCancelled(m_node, m_requestRecord, m_requestStartTime);
+				m_requestRecord = NULL;
+
+				m_clientEndpoint->Close();
+				m_clientEndpoint->Open();
+			}
+
+			response = m_hedgeRequest->GetResponse();
+
+			FinishHedge('h');
+			Request_onReceiveResponseCallback(response);
+			return;
+		}
+
+		// primary request still outstanding - it decides the step
+		if (m_heldOutcome == OutcomeNone)
+		{
+			return;
+		}
+
+		outcome = m_heldOutcome;
+		response = m_heldResponse;
+
+		FinishHedge('n');
+
+		switch (outcome)
+		{
+			case OutcomeSendFailure: Request_onSendFailureCallback(); break;
+			case OutcomeResponse: Request_onReceiveResponseCallback(response); break;
+			case OutcomeResponseTimeout: Request_onResponseTimeoutCallback(); break;
+			case OutcomeNone: break;
+		}
+	}
+
+	// outcome of the shared request - delivered as the outcome of the own request, attached callers
+	// get the response within their own conversation (errors are recorded against it)
+	void OnCoalescedRequestCompleted (bool success)
+	{
+		Ptr<Message>		response = m_coalescedRequest->GetResponse();
+		Ptr<Message>		ownResponse;
+
+
+		if (!m_isCoalescedWaiting)
+		{
+			return;
+		}
+
+		m_isCoalescedWaiting = false;
+
+		if (response != NULL && !m_isCoalescedSender)
+		{
+			ownResponse = CreateObject<Message>();
+
+			if (response->GetMessageType() == Message::MTResponseException)
+			{
+				ownResponse->InitializeResponseException(m_conversationMsg);
+			}
+			else
+			{
+				ownResponse->InitializeResponse(m_conversationMsg, response->GetSize());
+			}
+
+			Request_onReceiveResponseCallback(ownResponse);
+		}
+		else if (response != NULL)
+		{
+			Request_onReceiveResponseCallback(response);
+		}
+		else if (m_coalescedRequest->IsSendFailed())
+		{
+			Request_onSendFailureCallback();
+		}
+		else
+		{
+			Request_onResponseTimeoutCallback();
+		}
+	}
+
+	// failed primary request of hedged step - kept if the hedge request may still succeed
+	bool HoldOutcomeForHedge (RequestOutcome outcome, Ptr<Message> response)
+	{
+		if (!m_isHedgeActive)
+		{
+			return false;
+		}
+
+		if (m_hedgeRequest != NULL && m_hedgeRequest->IsOutstanding())
+		{
+			m_heldOutcome = outcome;
+			m_heldResponse = response;
+			return true;
+		}
+
+		FinishHedge('n');
+		return false;
+	}
+
+	// winner - 'p' primary request, 'h' hedge request, 'n' none
+	void FinishHedge (char winner)
+	{
+		Time		latency = Simulator::Now() - m_hedgeStartTime;
+
+
+		m_hedgeEvent.Cancel();
+		m_isHedgeActive = false;
+		m_heldOutcome = OutcomeNone;
+		m_heldResponse = NULL;
+
+		if (m_hedgeRequest != NULL && m_hedgeRequest->IsOutstanding())
+		{
+			m_hedgeRequest->Cancel();
+			s_abandonedHedgedRequestCounter++;
+		}
+
+		s_hedgedStepLatency += latency;
+
+		if (winner == 'h')
+		{
+			s_hedgeWinCounter++;
+			s_hedgeWinLatency += latency;
+		}
+
+		m_simulationOutput->RecordHedgedStep(
+				m_serviceBase->GetServiceId(),
+				m_conversationMsg,
+				m_hedgeCandidates[0]->GetService()->GetServiceId(),
+				m_hedgeCandidates[1]->GetService()->GetServiceId(),
+				m_hedgeDelay,
+				m_isHedgeSent,
+				winner,
+				latency);
+	}
+
+	void ReleaseGroupRequests ()
+	{
+		for (uint32_t i = 0; i < m_groupRequests.size(); i++)
+		{
+			m_groupRequests[i]->Cancel();
+		}
+
+		m_groupRequests.clear();
+	}
+
+	void SendMessage(uint32_t destNode, uint32_t destService, Address to, uint32_t destMethod, uint32_t size)
+	{
+		m_clientEndpoint->SendMessage(
+				CreateRequestMessage(destNode, destService, destMethod, size),
+				to,
+				true);
+	}
+
+	Ptr<Message> CreateRequestMessage(uint32_t destNode, uint32_t destService, uint32_t destMethod, uint32_t size)
+	{
+		Ptr<Message> 	msg = CreateObject<Message>();
+
+
+		// new conversation
+		if (m_conversationMsg == NULL)
+		{
+			// the conversation is awaited by the client for its response timeout
+			msg->InitializeNew(
+							m_node->GetId(),
+							m_serviceBase->GetServiceId(),
+							destNode,
+							destService,
+							destMethod,
+							size,
+							Simulator::Now() + m_serviceBase->GetResponseTimeout());
+		}
+		else // continue conversation
+		{
+			msg->InitializeNext (
+					m_conversationMsg,
+					destNode,
+					destService,
+					destMethod,
+					size);
+		}
+
+		return msg;
+	}
+
+	// ranked destinations to m_hedgeCandidates
+	void FindRequestDestinations(uint32_t contractId, uint32_t count)
+	{
+		ServiceRegistry::SelectDestinationServices(
+				m_node,
+				contractId,
+				(m_conversationMsg == NULL) ? 0 : m_conversationMsg->GetConversationId(),
+				m_serviceBase->GetServiceId(),
+				count,
+				m_hedgeCandidates);
+	}
+
+	Ptr<ServiceRegistryRecord> FindRequestDestination(uint32_t contractId)
+	{
+		return ServiceRegistry::SelectDestinationService(
+				m_node,
+				contractId,
+				(m_conversationMsg == NULL) ? 0 : m_conversationMsg->GetConversationId(),
+				m_serviceBase->GetServiceId());
+	}
+
+}; // ExecutionPlanExecuter
+
+uint32_t		ExecutionPlanExecuter::s_groupCounter = 0;
+uint32_t		ExecutionPlanExecuter::s_joinedGroupCounter = 0;
+uint32_t		ExecutionPlanExecuter::s_abandonedGroupRequestCounter = 0;
+Time			ExecutionPlanExecuter::s_groupLatency = Seconds(0);
+uint32_t		ExecutionPlanExecuter::s_hedgedStepCounter = 0;
+uint32_t		ExecutionPlanExecuter::s_hedgeRequestCounter = 0;
+uint32_t		ExecutionPlanExecuter::s_hedgeWinCounter = 0;
+uint32_t		ExecutionPlanExecuter::s_abandonedHedgedRequestCounter = 0;
+Time			ExecutionPlanExecuter::s_hedgedStepLatency = Seconds(0);
+Time			ExecutionPlanExecuter::s_hedgeWinLatency = Seconds(0);
+
+
+class ServiceExecutionPlanExecuter : public ExecutionPlanExecuter
+{
+private:
+	Ptr<ServiceExecutionPlan>			m_servicePlan;
+	int		 							m_currentStep;
+	Callback<void, bool> 				m_onExecutionStop;
+	const RandomVariable				m_stepSelector;
+	EventId								m_finishedWithErrorDelay;
+
+	static uint32_t						s_numberOfDeadlineAbortedExecutions;
+
+
+public:
+
+	ServiceExecutionPlanExecuter (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<Message> conversationMsg,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ServiceExecutionPlan> servicePlan,
+			Callback<void, bool> onExecutionStop)
+			:ExecutionPlanExecuter(
+					node,
+					serviceBase,
+					conversationMsg,
+					simulationOutput,
+					servicePlan),
+			 m_servicePlan(servicePlan),
+			 m_onExecutionStop(onExecutionStop),
+			 m_stepSelector (UniformVariable(0, 1))
+	{
+		NS_ASSERT(servicePlan != NULL);
+		NS_ASSERT(servicePlan->IsFinalized());
+		NS_ASSERT(!onExecutionStop.IsNull());
+	}
+
+	virtual ~ServiceExecutionPlanExecuter()
+	{
+		Stop();
+	}
+
+	// reused for the next request - the stop callback remains the same
+	void Reinitialize (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<Message> conversationMsg,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ServiceExecutionPlan> servicePlan)
+	{
+		NS_ASSERT(servicePlan != NULL);
+		NS_ASSERT(servicePlan->IsFinalized());
+
+		m_finishedWithErrorDelay.Cancel();
+
+		ExecutionPlanExecuter::Reinitialize(
+				node,
+				serviceBase,
+				conversationMsg,
+				simulationOutput,
+				servicePlan);
+
+		m_servicePlan = servicePlan;
+	}
+
+	static uint32_t GetNumberOfDeadlineAbortedExecutions () { return s_numberOfDeadlineAbortedExecutions; }
+
+protected:
+
+	virtual void OnStart()
+	{
+		m_currentStep = -1;
+		ExecuteNextStep();
+	}
+
+	// stopped task is released or pooled - the delayed finish must not reach it
+	virtual void OnStop()
+	{
+		m_finishedWithErrorDelay.Cancel();
+	}
+
+	virtual void ExecuteNextStep ()
+	{
+		int stepsCount = (int)m_servicePlan->GetExecutionStepsCount();
+
+
+		// remaining steps are skipped - their result would not be awaited
+		if (m_currentStep <= stepsCount && IsConversationDeadlineExpired())
+		{
+			s_numberOfDeadlineAbortedExecutions++;
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_DEADLINE_EXPIRED, GetConversationMessage(), "remaining steps skipped");
+			PlanFinished(false);
+			return;
+		}
+
+		// first step - pre exe delay
+		if (m_currentStep == -1)
+		{
+			ExecuteNextStepAfterWork (m_servicePlan->GetPlanPreExeDelay());
+			m_currentStep++;
+			return;
+		}
+
+		// send request step(s)
+		if (m_currentStep < stepsCount)
+		{
+			// find step to execute - based on configured probability of steps
+			m_currentStep = FindStepToExecute();
+
+			// step found
+			if (m_currentStep < stepsCount)
+			{
+				if (m_servicePlan->GetStepParallelGroup(m_currentStep) != 0)
+				{
+					ExecuteSendGroup(FindGroupStepsToExecute());
+					return;
+				}
+
+				ExecuteSendMessage(m_currentStep);
+				m_currentStep++;
+				return;
+			}
+		}
+
+		// last step - post exe delay
+		if (m_currentStep == stepsCount)
+		{
+			ExecuteNextStepAfterWork (m_servicePlan->GetPlanPostExeDelay());
+			m_currentStep++;
+			return;
+		}
+
+		// end of execution
+		if (m_currentStep > stepsCount)
+		{
+			PlanFinished(true);
+			return;
+		}
+	}
+
+	virtual void Request_onSendSuccessCallback()
+	{}
+
+	virtual void Request_onSendFailureCallback()
+	{
+		ExecutePlanFinishedWithErrorDelay();
+	}
+
+	virtual void Request_onReceiveResponseCallback(Ptr<Message> msg)
+	{
+		NS_ASSERT(msg != NULL);
+
+		// delay of the step
+		const RandomVariable &		delay 			= m_servicePlan->GetStepPostExeDelay();
+
+
+		// check for exception - if yes cancel the task
+		if (msg->GetMessageType() == Message::MTResponseException)
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_RECEIVED_EXCEPTION, msg);
+			ExecutePlanFinishedWithErrorDelay();
+		}
+		else
+		{
+			ExecuteNextStepAfterWork(delay);
+		}
+	}
+
+	virtual void Request_onResponseTimeoutCallback()
+	{
+		ExecutePlanFinishedWithErrorDelay();
+	}
+
+	virtual void Group_onFinishedCallback(bool joined)
+	{
+		if (joined)
+		{
+			ExecuteNextStepAfterWork(m_servicePlan->GetStepPostExeDelay());
+		}
+		else
+		{
+			ExecutePlanFinishedWithErrorDelay();
+		}
+	}
+
+	void ExecutePlanFinishedWithErrorDelay()
+	{
+		Time			delayValue = MilliSeconds(m_servicePlan->GetPostPlanErrorDelay().GetInteger());
+
+
+		m_finishedWithErrorDelay = Simulator::Schedule (
+				delayValue,
+				&ServiceExecutionPlanExecuter::PlanFinished,
+				this,
+				false);
+	}
+
+	void PlanFinished(bool success)
+	{
+		Stop();
+		m_onExecutionStop(success);
+	}
+
+	// steps count if no step is selected
+	uint32_t FindStepToExecute()
+	{
+		return m_servicePlan->SelectNextStep(m_currentStep, m_stepSelector.GetValue());
+	}
+
+	// current step is the first selected step of its group - remaining steps of the group
+	// are selected independently, current step is moved after the group
+	vector<uint32_t> FindGroupStepsToExecute()
+	{
+		const uint32_t		parallelGroup = m_servicePlan->GetStepParallelGroup(m_currentStep);
+		int					stepsCount = (int)m_servicePlan->GetExecutionStepsCount();
+		vector<uint32_t>	steps;
+
+
+		steps.push_back(m_currentStep);
+		m_currentStep++;
+
+		while (m_currentStep < stepsCount)
+		{
+			if (m_servicePlan->GetStepParallelGroup(m_currentStep) != parallelGroup)
+			{
+				break;
+			}
+
+			if (m_stepSelector.GetValue () * 100 <= m_servicePlan->GetStepProbability(m_currentStep))
+			{
+				steps.push_back(m_currentStep);
+			}
+
+			m_currentStep++;
+		}
+
+		return steps;
+	}
+
+}; // ServiceExecutionPlanExecuter
+
+uint32_t ServiceExecutionPlanExecuter::s_numberOfDeadlineAbortedExecutions = 0;
+
+
+
+
+class ClientExecutionPlanExecuter : public ExecutionPlanExecuter
+{
+private:
+	const Ptr<ClientExecutionPlan>				m_clientPlan;
+	const RandomVariable						m_stepSelector;
+	const RandomVariable						m_stepProbabilitySelector;
+	uint32_t									m_latestStep;
+	// single conversation (open loop arrival) - null if requests are executed in a closed loop
+	Callback<void, bool>						m_onConversationFinished;
+	EventId										m_conversationFinishedEvent;
+
+public:
+
+	ClientExecutionPlanExecuter (
+			Ptr<Node> node,
+			Ptr<ServiceBase> serviceBase,
+			Ptr<Message> conversationMsg,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ClientExecutionPlan> clientPlan,
+			Callback<void, bool> onConversationFinished = MakeNullCallback<void, bool>())
+			:ExecutionPlanExecuter(
+					node,
+					serviceBase,
+					conversationMsg,
+					simulationOutput,
+					clientPlan),
+			m_clientPlan (clientPlan),
+			m_stepSelector (UniformVariable(0, 1)),
+			m_stepProbabilitySelector (UniformVariable(0, 1)),
+			m_onConversationFinished (onConversationFinished)
+	{
+		NS_ASSERT(clientPlan != NULL);
+		NS_ASSERT(clientPlan->IsFinalized());
+	}
+
+	virtual ~ClientExecutionPlanExecuter()
+	{
+		Stop();
+		m_conversationFinishedEvent.Cancel();
+	}
+
+protected:
+
+	virtual void OnStart()
+	{
+		if (!m_onConversationFinished.IsNull())
+		{
+			ExecuteNextStep();
+			return;
+		}
+
+		WaitBeforeNextStep();
+	}
+
+	virtual void ExecuteNextStep ()
+	{
+		uint32_t step = FindNextStepToExecute();
+
+		//NS_LOG_UNCOND("client: ExecuteNextStep clientid " << m_serviceBase->GetServiceId() << " stepid: " << step);
+
+		ExecuteSendMessage(step);
+	}
+
+	// step with probability proportional to its step probability
+	uint32_t FindNextStepToExecute()
+	{
+		return m_clientPlan->SelectStep(
+				m_stepSelector.GetValue(),
+				m_stepProbabilitySelector.GetValue());
+	}
+
+	void WaitBeforeNextStep()
+	{
+		ExecuteNextStepWithDelay(m_clientPlan->GetRequestRate());
+	}
+
+	void WaitAfterFailure()
+	{
+		//NS_LOG_UNCOND("client " << m_serviceBase->GetServiceId() << " WaitAfterFailure");
+		ExecuteNextStepWithDelay(m_clientPlan->GetAfterFailureWaitingPeriod());
+	}
+
+	// the executer may be released by the owner of the conversation - finished out of the endpoint callback
+	void FinishConversation(bool success)
+	{
+		m_conversationFinishedEvent = Simulator::ScheduleNow(
+				&ClientExecutionPlanExecuter::ConversationFinished,
+				this,
+				success);
+	}
+
+	void ConversationFinished(bool success)
+	{
+		Stop();
+		m_onConversationFinished(success);
+	}
+
+	virtual void Request_onSendSuccessCallback()
+	{}
+
+	virtual void Request_onSendFailureCallback()
+	{
+		if (!m_onConversationFinished.IsNull())
+		{
+			FinishConversation(false);
+			return;
+		}
+
+		WaitBeforeNextStep();
+	}
+
+	virtual void Request_onReceiveResponseCallback(Ptr<Message> msg)
+	{
+		if (msg->GetMessageType() == Message::MTResponseException)
+		{
+			m_simulationOutput->RecordError(m_serviceBase->GetServiceId(), ERROR_TYPE_RECEIVED_EXCEPTION, msg);
+		}
+
+		if (!m_onConversationFinished.IsNull())
+		{
+			FinishConversation(msg->GetMessageType() != Message::MTResponseException);
+			return;
+		}
+
+		if (msg->GetMessageType() == Message::MTResponseException)
+		{
+			WaitAfterFailure();
+		}
+		else
+		{
+			WaitBeforeNextStep();
+		}
+	}
+
+	virtual void Request_onResponseTimeoutCallback()
+	{
+		if (!m_onConversationFinished.IsNull())
+		{
+			FinishConversation(false);
+			return;
+		}
+
+		//WaitBeforeNextStep();
+		WaitAfterFailure();
+	}
+
+	// client steps are selected one at a time - parallel groups are not executed by clients
+	virtual void Group_onFinishedCallback(bool joined)
+	{
+		NS_ASSERT(false);
+	}
+
+}; // ClientExecutionPlanExecuter
+
+
+
+
+
+/*
+ * Processing of a request
+ * 		Task is initialized for a request, started and completed once its response is sent (or when
+ * 		no response is sent) - the owner is notified to release it. Tasks (with their executers)
+ * 		are reused - initialized again for another request after being released.
+ */
+class ServiceRequestTask : public Object, public InstanceCounter
+{
+private:
+	Ptr<Node> 							m_node;
+	Ptr<Service> 						m_service;
+	Ptr<Message> 						m_conversationMsg;
+	Address 							m_requestAddress;
+	Ptr<ServiceMethod> 					m_requestMethod;
+	Ptr<SimulationOutput> 				m_simulationOutput;
+	Ptr<ServiceExecutionPlanExecuter>	m_planExecuter;
+	Ptr<ClientMessageEndpoint> 			m_responseEndpoint;
+	EventId								m_errorStopEvent;
+	EventId								m_cachedResponseEvent;
+	bool								m_isCompleted;
+	bool								m_isResponseIssued;
+	// key of the request in the response cache of the method - valid only if the method caches
+	uint32_t							m_cacheKey;
+	bool								m_isResponseCached;
+	Ptr<CancellationToken>				m_cancellationToken;
+	Callback<void, Ptr<ServiceRequestTask> >	m_onProcessingFinished;
+	Callback<void, Ptr<ServiceRequestTask> >	m_onCompleted;
+
+	static uint32_t						s_numberOfStartedMethods;
+	static uint32_t						s_numberOfFailedMethods;
+	static uint32_t						s_numberOfFailedExecutions;
+	static uint32_t						s_numberOfServiceFailures;
 	static uint32_t						s_numberOfIssuedExceptionMessages;
+	static uint32_t						s_numberOfCancelledTasks;
+	static uint32_t						s_numberOfExpiredResponsesSkipped;
 
 public:
 
-	ServiceRequestTask (
+	ServiceRequestTask ()
+		:InstanceCounter(typeid(this).name()),
+		 m_isCompleted (true),
+		 m_cacheKey (0),
+		 m_isResponseCached (false)
+	{}
+
+	virtual ~ServiceRequestTask()
+	{
+		Stop();
+	}
+
+	// processing of the request - onCompleted is called once the task is done
+	void Initialize (
 			Ptr<Node> node,
 			Ptr<Service> service,
 			Ptr<Message> conversationMsg,
 			Address requestAddress,
-			Ptr<ServiceTaskManager> taskManager,
-			Ptr<SimulationOutput> simulationOutput)
-		:InstanceCounter(typeid(this).name()),
-		 m_node(node),
-		 m_service (service),
-		m_conversationMsg (conversationMsg),
-		m_requestAddress (requestAddress),
-		m_taskManager (taskManager),
-		m_simulationOutput (simulationOutput)
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<CancellationToken> cancellationToken,
+			Callback<void, Ptr<ServiceRequestTask> > onProcessingFinished,
+			Callback<void, Ptr<ServiceRequestTask> > onCompleted)
 	{
+		NS_ASSERT(cancellationToken != NULL);
 		NS_ASSERT(service != NULL);
 		NS_ASSERT(node != NULL);
 		NS_ASSERT(conversationMsg != NULL);
-		NS_ASSERT(taskManager != NULL);
 		NS_ASSERT(simulationOutput != NULL);
+		NS_ASSERT(!onProcessingFinished.IsNull());
+		NS_ASSERT(!onCompleted.IsNull());
+		NS_ASSERT(m_isCompleted);
+
+		m_node = node;
+		m_service = service;
+		m_conversationMsg = conversationMsg;
+		m_requestAddress = requestAddress;
+		m_simulationOutput = simulationOutput;
+		m_onProcessingFinished = onProcessingFinished;
+		m_onCompleted = onCompleted;
+		m_cancellationToken = cancellationToken;
+		m_isCompleted = false;
+		m_isResponseIssued = false;
+		m_isResponseCached = false;
 
 		m_requestMethod = GetRequestMethod();
 		NS_ASSERT(m_requestMethod != NULL);
 
-		m_planExecuter = CreateObject<ServiceExecutionPlanExecuter>(
-				node,
-				m_service,
-				m_conversationMsg,
-				m_simulationOutput,
-				m_requestMethod->GetExecutionPlan(),
-				MakeCallback(&ServiceRequestTask::OnExecutionStopCallback, this));
+		if (m_planExecuter == NULL)
+		{
+			m_planExecuter = CreateObject<ServiceExecutionPlanExecuter>(
+					node,
+					m_service,
+					m_conversationMsg,
+					m_simulationOutput,
+					m_requestMethod->GetExecutionPlan(),
+					MakeCallback(&ServiceRequestTask::OnExecutionStopCallback, this));
+		}
+		else
+		{
+			m_planExecuter->Reinitialize(
+					node,
+					m_service,
+					m_conversationMsg,
+					m_simulationOutput,
+					m_requestMethod->GetExecutionPlan());
+		}
+
+		m_planExecuter->SetCancellationToken(m_cancellationToken);
 	}
 
-	virtual ~ServiceRequestTask()
+	// released task - references to the request are dropped, the executer is kept for reuse
+	void Release ()
 	{
 		Stop();
-		m_errorStopEvent.Cancel();
+
+		m_isCompleted = true;
+		m_node = NULL;
+		m_service = NULL;
+		m_conversationMsg = NULL;
+		m_requestMethod = NULL;
+		m_cancellationToken = NULL;
+		m_planExecuter->SetCancellationToken(NULL);
+		m_onProcessingFinished = MakeNullCallback<void, Ptr<ServiceRequestTask> >();
+		m_onCompleted = MakeNullCallback<void, Ptr<ServiceRequestTask> >();
 	}
 
 	void Start ()
@@ -4165,6 +9776,11 @@ public:
 		bool isGeneratingException = false;
 
 
+		if (m_cancellationToken->IsCancelled())
+		{
+			return;
+		}
+
 		// check if there is service error - if yes send exception (if required)
 		if (IsServiceProcessingError(isGeneratingException))
 		{
@@ -4174,6 +9790,17 @@ public:
 			return;
 		}
 
+		// cached response - the method is not processed
+		if (IsResponseCached())
+		{
+			m_cachedResponseEvent = Simulator::ScheduleNow (
+					&ServiceRequestTask::OnExecutionStop,
+					this,
+					true,
+					false);
+			return;
+		}
+
 		s_numberOfStartedMethods++;
 
 		// check if there is method error - if yes send exception
@@ -4190,15 +9817,61 @@ public:
 
 	void Stop ()
 	{
-		m_planExecuter->Stop();
+		if (m_planExecuter != NULL)
+		{
+			m_planExecuter->Stop();
+		}
+
+		m_errorStopEvent.Cancel();
+		m_cachedResponseEvent.Cancel();
 		StopServiceRequestTask();
 	}
 
+	// service stopped - timers and endpoints of the processing are released, the requester is
+	// answered with exception (if required) unless its response was issued already
+	void Cancel (bool isGeneratingException)
+	{
+		Stop();
+
+		if (isGeneratingException && !m_isResponseIssued && !m_isCompleted)
+		{
+			Reject();
+		}
+
+		s_numberOfCancelledTasks++;
+	}
+
+	// request not processed (e.g. service overloaded) - exception is sent back unless the
+	// requester does not await it any more
+	void Reject ()
+	{
+		Ptr<Message> 					msg = CreateObject<Message> ();
+
+
+		if (m_conversationMsg->IsDeadlineExpired())
+		{
+			s_numberOfExpiredResponsesSkipped++;
+			Complete();
+			return;
+		}
+
+		msg->InitializeResponseException(m_conversationMsg);
+		s_numberOfIssuedExceptionMessages++;
+
+		SendResponse(msg);
+	}
+
+	Ptr<Message> GetRequestMessage () const { return m_conversationMsg; }
+	// response (or exception) is being sent - the task completes once it is sent or fails
+	bool IsResponseIssued () const { return m_isResponseIssued; }
+
 	static uint32_t GetNumberOfStartedMethods () { return s_numberOfStartedMethods; }
 	static uint32_t GetNumberOfFailedMethods () {return s_numberOfFailedMethods; }
 	static uint32_t GetNumberOfFailedExecutions () {return s_numberOfFailedExecutions; }
 	static uint32_t GetNumberOfServiceFailures () {return s_numberOfServiceFailures; }
 	static uint32_t GetNumberOfIssuedExceptionMessages () {return s_numberOfIssuedExceptionMessages; }
+	static uint32_t GetNumberOfCancelledTasks () {return s_numberOfCancelledTasks; }
+	static uint32_t GetNumberOfExpiredResponsesSkipped () {return s_numberOfExpiredResponsesSkipped; }
 
 private:
 
@@ -4212,6 +9885,29 @@ private:
 		return m_service->GetFaultModel()->IsCorrupt(isGeneratingException);
 	}
 
+	bool IsResponseCached()
+	{
+		Ptr<ResponseCache>		cache = m_requestMethod->GetResponseCache();
+
+
+		if (cache == NULL)
+		{
+			return false;
+		}
+
+		m_cacheKey = cache->DrawKey(m_conversationMsg->GetSrcService());
+		m_isResponseCached = cache->Lookup(m_cacheKey);
+
+		m_simulationOutput->RecordCacheLookup(
+				m_service->GetServiceId(),
+				m_requestMethod->GetContractMethodId(),
+				m_cacheKey,
+				m_isResponseCached,
+				cache->GetSize());
+
+		return m_isResponseCached;
+	}
+
 	void ExecutionStopWithErrorDelay (bool isGeneratingException)
 	{
 		Time			delayValue = MilliSeconds(m_service->GetPostErrorDelay().GetInteger());
@@ -4240,6 +9936,12 @@ private:
 		if (success)
 		{
 			msg->InitializeResponse (m_conversationMsg, size);
+
+			// cached response does not extend its ttl
+			if (m_requestMethod->GetResponseCache() != NULL && !m_isResponseCached)
+			{
+				m_requestMethod->GetResponseCache()->Insert(m_cacheKey);
+			}
 		}
 		else
 		{
@@ -4252,20 +9954,56 @@ private:
 			}
 		}
 
+		// response is issued - processing is finished even if the response is still being sent
+		m_onProcessingFinished(this);
+
+		// requester does not await the response any more
+		if (m_conversationMsg->IsDeadlineExpired())
+		{
+			s_numberOfExpiredResponsesSkipped++;
+			Complete();
+			return;
+		}
+
 		if (success || isGeneratingException)
 		{
-			m_responseEndpoint = MessageEndpointFactory::CreateClientMessageEndpoint(
-					m_node,
-					m_service,
-					m_simulationOutput,
-					MakeCallback(&ServiceRequestTask::Response_onSendSuccessCallback, this),
-					MakeCallback(&ServiceRequestTask::Response_onSendFailureCallback, this),
-					MakeCallback(&ServiceRequestTask::Response_onReceiveResponseCallback, this),
-					MakeCallback(&ServiceRequestTask::Response_onResponseTimeoutCallback, this));
+			SendResponse(msg);
+		}
+		else
+		{
+			Complete();
+		}
+	}
 
-			m_responseEndpoint->Open();
-			m_responseEndpoint->SendMessage(msg, m_requestAddress, false);
+	void Complete ()
+	{
+		if (m_isCompleted)
+		{
+			return;
 		}
+
+		m_isCompleted = true;
+		StopServiceRequestTask();
+		m_onCompleted(this);
+	}
+
+	void SendResponse(Ptr<Message> msg)
+	{
+		NS_ASSERT(msg != NULL);
+
+		m_isResponseIssued = true;
+
+		m_responseEndpoint = MessageEndpointFactory::CreateClientMessageEndpoint(
+				m_node,
+				m_service,
+				m_simulationOutput,
+				MakeCallback(&ServiceRequestTask::Response_onSendSuccessCallback, this),
+				MakeCallback(&ServiceRequestTask::Response_onSendFailureCallback, this),
+				MakeCallback(&ServiceRequestTask::Response_onReceiveResponseCallback, this),
+				MakeCallback(&ServiceRequestTask::Response_onResponseTimeoutCallback, this));
+
+		m_responseEndpoint->Open();
+		m_responseEndpoint->SendMessage(msg, m_requestAddress, false);
 	}
 
 	void StopServiceRequestTask()
@@ -4288,19 +10026,22 @@ private:
 	// send processing response back to requester - callbacks from endpoint
 	void Response_onSendSuccessCallback()
 	{
-		StopServiceRequestTask();
+		Complete();
 	}
 
 	void Response_onSendFailureCallback()
 	{
-		StopServiceRequestTask();
+		Complete();
 	}
 
 	void Response_onReceiveResponseCallback(Ptr<Message> msg)
 	{}
 
+	// response endpoint gave up on the send (e.g. its deadline passed) - the task is done either way
 	void Response_onResponseTimeoutCallback()
-	{}
+	{
+		Complete();
+	}
 
 }; // ServiceRequestTask
 
@@ -4309,18 +10050,251 @@ uint32_t ServiceRequestTask::s_numberOfFailedMethods = 0;
 uint32_t ServiceRequestTask::s_numberOfFailedExecutions = 0;
 uint32_t ServiceRequestTask::s_numberOfServiceFailures = 0;
 uint32_t ServiceRequestTask::s_numberOfIssuedExceptionMessages = 0;
+uint32_t ServiceRequestTask::s_numberOfCancelledTasks = 0;
+uint32_t ServiceRequestTask::s_numberOfExpiredResponsesSkipped = 0;
+
+
+/*
+ * Tasks of a service instance
+ * 		Task is removed once it is completed (or stopped) - its executer and endpoints are released.
+ * 		Removed tasks are kept in a pool shared by all services (up to its capacity) and initialized
+ * 		again for following requests instead of creating new tasks and executers.
+ */
+class ServiceTaskManager : public Object, public InstanceCounter
+{
+private:
+	set<Ptr<ServiceRequestTask> > 				m_runningTasks;
+	// null if the owner is not notified
+	Callback<void, Ptr<ServiceRequestTask> >	m_onTaskRemoved;
+
+	static vector<Ptr<ServiceRequestTask> >		s_taskPool;
+	static const uint32_t						s_taskPoolCapacity;
+	static uint32_t								s_numberOfLiveTasks;
+	static uint32_t								s_numberOfCreatedTasks;
+	static uint32_t								s_numberOfReusedTasks;
+
+public:
+
+	ServiceTaskManager (Callback<void, Ptr<ServiceRequestTask> > onTaskRemoved = MakeNullCallback<void, Ptr<ServiceRequestTask> >())
+	:InstanceCounter(typeid(this).name()),
+	 m_onTaskRemoved(onTaskRemoved)
+	{}
+
+	virtual ~ServiceTaskManager()
+	{
+		NS_ASSERT(m_runningTasks.size() == 0);
+	}
+
+	Ptr<ServiceRequestTask> CreateTask (
+			Ptr<Node> node,
+			Ptr<Service> service,
+			Ptr<Message> conversationMsg,
+			Address requestAddress,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<CancellationToken> cancellationToken,
+			Callback<void, Ptr<ServiceRequestTask> > onProcessingFinished)
+	{
+		Ptr<ServiceRequestTask>			task;
+
+
+		if (s_taskPool.empty())
+		{
+			task = CreateObject<ServiceRequestTask>();
+			s_numberOfCreatedTasks++;
+		}
+		else
+		{
+			task = s_taskPool.back();
+			s_taskPool.pop_back();
+			s_numberOfReusedTasks++;
+		}
+
+		task->Initialize(
+				node,
+				service,
+				conversationMsg,
+				requestAddress,
+				simulationOutput,
+				cancellationToken,
+				onProcessingFinished,
+				MakeCallback(&ServiceTaskManager::RemoveTask, this));
+
+		m_runningTasks.insert(task);
+		s_numberOfLiveTasks++;
+
+		return task;
+	}
+
+	// completed, dropped or stopped task
+	void RemoveTask (Ptr<ServiceRequestTask> task)
+	{
+		NS_ASSERT(task);
+
+		if (m_runningTasks.erase(task) == 0)
+		{
+			return;
+		}
+
+		if (!m_onTaskRemoved.IsNull())
+		{
+			m_onTaskRemoved(task);
+		}
+
+		s_numberOfLiveTasks--;
+		task->Release();
+
+		if (s_taskPool.size() < s_taskPoolCapacity)
+		{
+			s_taskPool.push_back(task);
+		}
+	}
+
+	// tasks are cancelled and removed - requesters are answered with exception if required,
+	// tasks sending their response are not cut and are removed once completed
+	void StopAllTasks(bool isGeneratingException)
+	{
+		// removing modifies the set
+		vector<Ptr<ServiceRequestTask> >				tasks (m_runningTasks.begin(), m_runningTasks.end());
+		vector<Ptr<ServiceRequestTask> >::iterator 		it;
+
+
+		for (it=tasks.begin(); it!=tasks.end(); it++)
+		{
+			if ((*it)->IsResponseIssued())
+			{
+				continue;
+			}
+
+			(*it)->Cancel(isGeneratingException);
+
+			// exception of the cancelled task is being sent
+			if (!(*it)->IsResponseIssued())
+			{
+				RemoveTask(*it);
+			}
+		}
+	}
+
+	// pooled tasks hold executers - released before the simulator is destroyed
+	static void ClearTaskPool ()
+	{
+		s_taskPool.clear();
+	}
+
+	uint32_t GetNumberOfRunningTasks () const { return m_runningTasks.size(); }
+
+	static uint32_t GetNumberOfLiveTasks () { return s_numberOfLiveTasks; }
+	static uint32_t GetNumberOfPooledTasks () { return s_taskPool.size(); }
+	static uint32_t GetNumberOfCreatedTasks () { return s_numberOfCreatedTasks; }
+	static uint32_t GetNumberOfReusedTasks () { return s_numberOfReusedTasks; }
+
+}; // ServiceTaskManager
+
+vector<Ptr<ServiceRequestTask> >	ServiceTaskManager::s_taskPool;
+const uint32_t						ServiceTaskManager::s_taskPoolCapacity = 1000;
+uint32_t							ServiceTaskManager::s_numberOfLiveTasks = 0;
+uint32_t							ServiceTaskManager::s_numberOfCreatedTasks = 0;
+uint32_t							ServiceTaskManager::s_numberOfReusedTasks = 0;
+
+
+/*
+ * Worker pool
+ *
+ * With worker slots configured, at most that many requests are processed at once (from the start
+ * of the task till its response is issued), further requests wait in a bounded queue - in order
+ * of arrival (FIFO) or of their conversations (older conversations first, i.e. requests of
+ * conversations in progress are served before new ones). Requests not fitting in the queue are
+ * rejected with exception or dropped (requester times out).
+ * Without worker slots (default) every request is processed immediately.
+ * */
+class ServiceInstance : public Application, public InstanceCounter
+{
+public:
+
+	enum QueueDiscipline
+	{
+		QueueFifo,
+		QueueOldestConversationFirst
+	};
+
+	enum OverflowPolicy
+	{
+		OverflowRejectWithException,
+		OverflowDrop
+	};
+
+private:
+
+	struct QueuedTask
+	{
+		Ptr<ServiceRequestTask>		task;
+		Time						enqueueTime;
+		uint32_t					priority;
+		uint32_t					sequence;
 
+		// priority_queue serves the greatest - the lowest priority value and sequence first
+		bool operator< (const QueuedTask & other) const
+		{
+			if (priority != other.priority)
+			{
+				return priority > other.priority;
+			}
+
+			return sequence > other.sequence;
+		}
+	};
 
-class ServiceInstance : public Application, public InstanceCounter
-{
-private:
 	const Ptr<Service>					m_service;
 	const uint16_t						m_receivePort;
 	const Ptr<SimulationOutput> 		m_simulationOutput;
 	Ptr<ServerMessageEndpoint>			m_serverEndpoint;
 	Ptr<ServiceTaskManager> 			m_taskManager;
+	Ptr<CancellationToken>				m_cancellationToken;
+	// null if every request is admitted
+	Ptr<AdmissionController>			m_admissionController;
+	// key is the task of admitted request, value is its arrival
+	map<ServiceRequestTask *, Time>		m_admittedTasks;
+
+	// worker pool - 0 slots means unlimited
+	const uint32_t						m_workerSlots;
+	const uint32_t						m_queueCapacity;
+	const QueueDiscipline				m_queueDiscipline;
+	const OverflowPolicy				m_overflowPolicy;
+	uint32_t							m_busyWorkers;
+	uint32_t							m_queueSequence;
+	priority_queue<QueuedTask>			m_queue;
+	// key is the task being processed, value is its start
+	map<ServiceRequestTask *, Time>		m_workerStartTimes;
+	// start of the slot time not yet accounted in s_workerSlotTime
+	Time								m_workerSlotStartTime;
 
 	static uint32_t						s_numberOfServiceRequests;
+	static uint32_t						s_numberOfExpiredRequests;
+	static uint32_t						s_numberOfRateLimitedRequests;
+	static bool							s_isAnsweringOnStop;
+
+	static uint32_t						s_workerSlots;
+	static uint32_t						s_queueCapacity;
+	static QueueDiscipline				s_queueDiscipline;
+	static OverflowPolicy				s_overflowPolicy;
+
+	static bool							s_isAdmissionControlled;
+	static AdmissionController::Policy	s_admissionPolicy;
+	static uint32_t						s_admissionLimit;
+	static Time							s_admissionTarget;
+	static Time							s_admissionInterval;
+
+	static uint32_t						s_numberOfWorkerSlots;
+	static uint32_t						s_numberOfQueuedRequests;
+	// left the queue to be processed or dropped as expired - their waits are in s_queueWaitTime
+	static uint32_t						s_numberOfDequeuedRequests;
+	static uint32_t						s_numberOfRejectedRequests;
+	static uint32_t						s_numberOfDroppedRequests;
+	static Time							s_queueWaitTime;
+	static Time							s_busyWorkerTime;
+	// slots weighted by the time their instances were running
+	static Time							s_workerSlotTime;
+	static list<ServiceInstance *>		s_runningInstances;
 
 public:
 
@@ -4328,24 +10302,108 @@ public:
 		:InstanceCounter(typeid(this).name()),
 		 m_service (service),
 		 m_receivePort (receivePort),
-		 m_simulationOutput (simulationOutput)
+		 m_simulationOutput (simulationOutput),
+		 m_workerSlots (s_workerSlots),
+		 m_queueCapacity (s_queueCapacity),
+		 m_queueDiscipline (s_queueDiscipline),
+		 m_overflowPolicy (s_overflowPolicy),
+		 m_busyWorkers (0),
+		 m_queueSequence (0)
 	{
 		NS_ASSERT(service != NULL);
 		NS_ASSERT(receivePort > 0);
 		NS_ASSERT(simulationOutput != NULL);
 
-		m_taskManager = CreateObject<ServiceTaskManager>();
+		m_taskManager = CreateObject<ServiceTaskManager>(MakeCallback(&ServiceInstance::OnTaskRemoved, this));
+		s_numberOfWorkerSlots += m_workerSlots;
+
+		// instances are created when the configuration is loaded - before any message is sent
+		if (service->GetRateLimit() > 0 && service->GetRateLimitKey() == Service::RateLimitByOriginClient)
+		{
+			Message::EnableOriginPropagation();
+		}
 	}
 
 	virtual ~ServiceInstance() {}
 
+	// applies to service instances created afterwards
+	static void ConfigureWorkerPool (
+			uint32_t workerSlots,
+			uint32_t queueCapacity,
+			QueueDiscipline queueDiscipline,
+			OverflowPolicy overflowPolicy)
+	{
+		s_workerSlots = workerSlots;
+		s_queueCapacity = queueCapacity;
+		s_queueDiscipline = queueDiscipline;
+		s_overflowPolicy = overflowPolicy;
+	}
+
+	// applies to service instances started afterwards - limit is the initial and maximum limit for
+	// AdaptiveLimit, target is the queue delay (QueueDelayTarget) or latency (AdaptiveLimit) target
+	static void ConfigureAdmissionControl (
+			AdmissionController::Policy policy,
+			uint32_t limit,
+			Time target,
+			Time interval)
+	{
+		s_isAdmissionControlled = true;
+		s_admissionPolicy = policy;
+		s_admissionLimit = limit;
+		s_admissionTarget = target;
+		s_admissionInterval = interval;
+	}
+
+	// requests in progress or queued when a service stops are answered with exception
+	static void EnableExceptionsOnStop ()
+	{
+		s_isAnsweringOnStop = true;
+	}
+
 	static uint32_t GetNumberOfServiceRequests () { return s_numberOfServiceRequests; }
-	//Ptr<Service> GetService() { return m_service; }
+	static uint32_t GetNumberOfExpiredRequests () { return s_numberOfExpiredRequests; }
+	static uint32_t GetNumberOfRateLimitedRequests () { return s_numberOfRateLimitedRequests; }
+	static uint32_t GetNumberOfWorkerSlots () { return s_numberOfWorkerSlots; }
+	static uint32_t GetNumberOfQueuedRequests () { return s_numberOfQueuedRequests; }
+	static uint32_t GetNumberOfDequeuedRequests () { return s_numberOfDequeuedRequests; }
+	static uint32_t GetNumberOfRejectedRequests () { return s_numberOfRejectedRequests; }
+	static uint32_t GetNumberOfDroppedRequests () { return s_numberOfDroppedRequests; }
+	static Time GetQueueWaitTime () { return s_queueWaitTime; }
+	static Time GetBusyWorkerTime () { return s_busyWorkerTime; }
+	static Time GetWorkerSlotTime () { return s_workerSlotTime; }
+	Ptr<Service> GetService() { return m_service; }
+
+	// called before the simulator is destroyed - the run time is lost afterwards
+	static void FlushUtilization ()
+	{
+		for (list<ServiceInstance *>::iterator it = s_runningInstances.begin(); it != s_runningInstances.end(); it++)
+		{
+			(*it)->FlushWorkerTime();
+		}
+
+		s_runningInstances.clear();
+	}
+
+	// no request is being processed, queued or answered
+	bool IsIdle () const
+	{
+		return m_taskManager->GetNumberOfRunningTasks() == 0;
+	}
+
+	// stops the service before its stop time (e.g. by the autoscaler)
+	void Retire ()
+	{
+		StopApplication();
+	}
 
 private:
 
 	virtual void StartApplication (void)
 	{
+		m_cancellationToken = CreateObject<CancellationToken>();
+		m_workerSlotStartTime = Simulator::Now();
+		s_runningInstances.push_back(this);
+
 		m_serverEndpoint = MessageEndpointFactory::CreateServerMessageEndpoint(
 				GetNode(),
 				m_service,
@@ -4353,6 +10411,31 @@ private:
 				MakeCallback(&ServiceInstance::OnReceiveRequest, this),
 				m_receivePort);
 
+		if (s_isAdmissionControlled)
+		{
+			m_admissionController = CreateObject<AdmissionController>(
+					s_admissionPolicy,
+					s_admissionLimit,
+					s_admissionTarget,
+					s_admissionInterval,
+					m_service->GetServiceId(),
+					m_simulationOutput);
+
+			m_serverEndpoint->SetAdmissionControl(
+					m_admissionController,
+					MakeCallback(&ServiceInstance::OnRejectRequest, this));
+		}
+
+		if (m_service->GetRateLimit() > 0)
+		{
+			m_serverEndpoint->SetClientRateLimit(
+					CreateObject<ClientRateLimiter>(
+							m_service->GetRateLimit(),
+							m_service->GetRateBurst(),
+							m_service->GetRateLimitKey()),
+					MakeCallback(&ServiceInstance::OnLimitRequest, this));
+		}
+
 		m_serverEndpoint->Open();
 
 		ServiceRegistry::RegisterService (
@@ -4363,8 +10446,56 @@ private:
 
 	virtual void StopApplication (void)
 	{
-		m_taskManager->StopAllTasks();
+		// retired already
+		if (m_serverEndpoint == NULL)
+		{
+			return;
+		}
+
+		ServiceRegistry::DeregisterService(m_service->GetServiceId());
+
+		// no further work is started by tasks or their executers
+		m_cancellationToken->Cancel();
+
+		// queued requests are not processed
+		while (!m_queue.empty())
+		{
+			m_queue.top().task->Cancel(s_isAnsweringOnStop);
+
+			// exception is being sent - the task is removed once completed
+			if (!m_queue.top().task->IsResponseIssued())
+			{
+				m_taskManager->RemoveTask(m_queue.top().task);
+			}
+
+			m_queue.pop();
+		}
+
+		// processing workers are released
+		FlushWorkerTime();
+		s_runningInstances.remove(this);
+
+		m_workerStartTimes.clear();
+		m_busyWorkers = 0;
+
+		m_taskManager->StopAllTasks(s_isAnsweringOnStop);
 		m_serverEndpoint->Close();
+		m_serverEndpoint = NULL;
+		m_admissionController = NULL;
+		m_admittedTasks.clear();
+	}
+
+	// busy and slot time since the last flush are accounted
+	void FlushWorkerTime ()
+	{
+		for (map<ServiceRequestTask *, Time>::iterator it = m_workerStartTimes.begin(); it != m_workerStartTimes.end(); it++)
+		{
+			s_busyWorkerTime += Simulator::Now() - it->second;
+			it->second = Simulator::Now();
+		}
+
+		s_workerSlotTime += Seconds(m_workerSlots * (Simulator::Now() - m_workerSlotStartTime).GetSeconds());
+		m_workerSlotStartTime = Simulator::Now();
 	}
 
 	void OnReceiveRequest (Ptr<Message> msg, Address from)
@@ -4376,37 +10507,334 @@ private:
 
 		s_numberOfServiceRequests++;
 
-		task = CreateObject<ServiceRequestTask>(
+		// requester does not await the response any more - dropped without processing
+		if (msg->IsDeadlineExpired())
+		{
+			s_numberOfExpiredRequests++;
+			m_simulationOutput->RecordError(m_service->GetServiceId(), ERROR_TYPE_DEADLINE_EXPIRED, msg, "dropped on arrival");
+
+			if (m_admissionController != NULL)
+			{
+				m_admissionController->OnRequestReleased();
+			}
+
+			return;
+		}
+
+		task = m_taskManager->CreateTask(
+				GetNode(),
+				m_service,
+				msg,
+				from,
+				m_simulationOutput,
+				m_cancellationToken,
+				MakeCallback(&ServiceInstance::OnTaskProcessingFinished, this));
+
+		if (m_admissionController != NULL)
+		{
+			m_admittedTasks[PeekPointer(task)] = Simulator::Now();
+		}
+
+		// unlimited
+		if (m_workerSlots == 0)
+		{
+			if (m_admissionController != NULL)
+			{
+				m_admissionController->OnRequestStarted(Seconds(0));
+			}
+
+			task->Start();
+			return;
+		}
+
+		if (m_busyWorkers < m_workerSlots)
+		{
+			StartTask(task, Seconds(0));
+			return;
+		}
+
+		if (m_queue.size() < m_queueCapacity)
+		{
+			EnqueueTask(task);
+			return;
+		}
+
+		if (m_overflowPolicy == OverflowRejectWithException)
+		{
+			s_numberOfRejectedRequests++;
+			RecordQueueEvent('r', task, Seconds(0));
+			task->Reject();
+		}
+		else
+		{
+			s_numberOfDroppedRequests++;
+			RecordQueueEvent('d', task, Seconds(0));
+			m_taskManager->RemoveTask(task);
+		}
+	}
+
+	// not admitted by the server endpoint - answered with exception without processing
+	void OnRejectRequest (Ptr<Message> msg, Address from)
+	{
+		NS_ASSERT(msg != NULL);
+
+		s_numberOfServiceRequests++;
+
+		RejectRequest(msg, from);
+	}
+
+	// client over its quota - answered with exception without processing
+	void OnLimitRequest (Ptr<Message> msg, Address from)
+	{
+		NS_ASSERT(msg != NULL);
+
+		s_numberOfServiceRequests++;
+		s_numberOfRateLimitedRequests++;
+		m_simulationOutput->RecordError(m_service->GetServiceId(), ERROR_TYPE_RATE_LIMITED, msg, "client over its quota");
+
+		RejectRequest(msg, from);
+	}
+
+	void RejectRequest (Ptr<Message> msg, Address from)
+	{
+		m_taskManager->CreateTask(
 				GetNode(),
 				m_service,
 				msg,
 				from,
-				m_taskManager,
-				m_simulationOutput);
+				m_simulationOutput,
+				m_cancellationToken,
+				MakeCallback(&ServiceInstance::OnTaskProcessingFinished, this))->Reject();
+	}
+
+	void OnTaskRemoved (Ptr<ServiceRequestTask> task)
+	{
+		map<ServiceRequestTask *, Time>::iterator		it = m_admittedTasks.find(PeekPointer(task));
+
+
+		if (it == m_admittedTasks.end())
+		{
+			return;
+		}
+
+		m_admittedTasks.erase(it);
+		m_admissionController->OnRequestReleased();
+	}
+
+	void EnqueueTask (Ptr<ServiceRequestTask> task)
+	{
+		QueuedTask		queuedTask;
+
 
-		m_taskManager->AddTask(task);
+		queuedTask.task = task;
+		queuedTask.enqueueTime = Simulator::Now();
+		queuedTask.priority = (m_queueDiscipline == QueueFifo) ? 0 : task->GetRequestMessage()->GetConversationId();
+		queuedTask.sequence = m_queueSequence++;
+
+		m_queue.push(queuedTask);
+		s_numberOfQueuedRequests++;
+
+		RecordQueueEvent('q', task, Seconds(0));
+	}
+
+	void StartTask (Ptr<ServiceRequestTask> task, Time waitTime)
+	{
+		m_busyWorkers++;
+		m_workerStartTimes[PeekPointer(task)] = Simulator::Now();
+		s_queueWaitTime += waitTime;
+
+		RecordQueueEvent('s', task, waitTime);
+
+		if (m_admissionController != NULL)
+		{
+			m_admissionController->OnRequestStarted(waitTime);
+		}
 
 		task->Start();
 	}
 
+	void OnTaskProcessingFinished (Ptr<ServiceRequestTask> task)
+	{
+		map<ServiceRequestTask *, Time>::iterator		it;
+		QueuedTask										queuedTask;
+
+
+		it = m_admittedTasks.find(PeekPointer(task));
+
+		if (it != m_admittedTasks.end())
+		{
+			m_admissionController->OnRequestProcessed(Simulator::Now() - it->second);
+		}
+
+		if (m_workerSlots == 0)
+		{
+			return;
+		}
+
+		it = m_workerStartTimes.find(PeekPointer(task));
+		NS_ASSERT(it != m_workerStartTimes.end());
+
+		s_busyWorkerTime += Simulator::Now() - it->second;
+		m_workerStartTimes.erase(it);
+		m_busyWorkers--;
+
+		RecordQueueEvent('f', task, Seconds(0));
+
+		while (!m_queue.empty() && m_serverEndpoint != NULL)
+		{
+			queuedTask = m_queue.top();
+			m_queue.pop();
+			s_numberOfDequeuedRequests++;
+
+			// expired while waiting - dropped without processing
+			if (queuedTask.task->GetRequestMessage()->IsDeadlineExpired())
+			{
+				s_numberOfExpiredRequests++;
+				s_queueWaitTime += Simulator::Now() - queuedTask.enqueueTime;
+				m_simulationOutput->RecordError(m_service->GetServiceId(), ERROR_TYPE_DEADLINE_EXPIRED, queuedTask.task->GetRequestMessage(), "dropped from queue");
+				RecordQueueEvent('x', queuedTask.task, Simulator::Now() - queuedTask.enqueueTime);
+				m_taskManager->RemoveTask(queuedTask.task);
+				continue;
+			}
+
+			StartTask(queuedTask.task, Simulator::Now() - queuedTask.enqueueTime);
+			break;
+		}
+	}
+
+	void RecordQueueEvent (char action, Ptr<ServiceRequestTask> task, Time waitTime)
+	{
+		m_simulationOutput->RecordQueueEvent(
+				m_service->GetServiceId(),
+				action,
+				task->GetRequestMessage(),
+				m_queue.size(),
+				m_busyWorkers,
+				m_workerSlots,
+				waitTime);
+	}
+
 }; // ServiceInstance
 
 uint32_t ServiceInstance::s_numberOfServiceRequests = 0;
+uint32_t ServiceInstance::s_numberOfExpiredRequests = 0;
+uint32_t ServiceInstance::s_numberOfRateLimitedRequests = 0;
+bool ServiceInstance::s_isAnsweringOnStop = false;
+uint32_t ServiceInstance::s_workerSlots = 0;
+uint32_t ServiceInstance::s_queueCapacity = 0;
+ServiceInstance::QueueDiscipline ServiceInstance::s_queueDiscipline = ServiceInstance::QueueFifo;
+ServiceInstance::OverflowPolicy ServiceInstance::s_overflowPolicy = ServiceInstance::OverflowRejectWithException;
+bool ServiceInstance::s_isAdmissionControlled = false;
+AdmissionController::Policy ServiceInstance::s_admissionPolicy = AdmissionController::ConcurrencyLimit;
+uint32_t ServiceInstance::s_admissionLimit = 1;
+Time ServiceInstance::s_admissionTarget = Seconds(0);
+Time ServiceInstance::s_admissionInterval = Seconds(0);
+uint32_t ServiceInstance::s_numberOfWorkerSlots = 0;
+uint32_t ServiceInstance::s_numberOfQueuedRequests = 0;
+uint32_t ServiceInstance::s_numberOfDequeuedRequests = 0;
+uint32_t ServiceInstance::s_numberOfRejectedRequests = 0;
+uint32_t ServiceInstance::s_numberOfDroppedRequests = 0;
+Time ServiceInstance::s_queueWaitTime = Seconds(0);
+Time ServiceInstance::s_busyWorkerTime = Seconds(0);
+Time ServiceInstance::s_workerSlotTime = Seconds(0);
+list<ServiceInstance *> ServiceInstance::s_runningInstances;
+
+
+/*
+ * Open loop arrival of a client - independent conversation with its own executer
+ */
+class ClientConversation : public Object
+{
+private:
+	const uint32_t									m_arrivalId;
+	const Time										m_intendedStartTime;
+	Callback<void, Ptr<ClientConversation>, bool>	m_onFinished;
+	Ptr<ClientExecutionPlanExecuter>				m_planExecuter;
+
+public:
+
+	ClientConversation (
+			Ptr<Node> node,
+			Ptr<Client> client,
+			Ptr<SimulationOutput> simulationOutput,
+			Ptr<ClientExecutionPlan> clientPlan,
+			uint32_t arrivalId,
+			Time intendedStartTime,
+			Callback<void, Ptr<ClientConversation>, bool> onFinished)
+		:m_arrivalId (arrivalId),
+		 m_intendedStartTime (intendedStartTime),
+		 m_onFinished (onFinished)
+	{
+		NS_ASSERT(!onFinished.IsNull());
+
+		m_planExecuter = CreateObject<ClientExecutionPlanExecuter>(
+								node,
+								client,
+								Ptr<Message>(NULL),
+								simulationOutput,
+								clientPlan,
+								MakeCallback(&ClientConversation::OnExecutionFinished, this));
+	}
+
+	virtual ~ClientConversation() {}
+
+	uint32_t GetArrivalId () const { return m_arrivalId; }
+	Time GetIntendedStartTime () const { return m_intendedStartTime; }
+
+	void Start ()
+	{
+		m_planExecuter->Start();
+	}
+
+	void Stop ()
+	{
+		m_planExecuter->Stop();
+	}
+
+private:
+
+	void OnExecutionFinished (bool success)
+	{
+		m_onFinished(this, success);
+	}
+
+}; // ClientConversation
 
 
+/*
+ * Client application
+ * 		Closed loop clients run a single executer - the next request is issued after the response.
+ * 		Open loop clients schedule arrivals of the plan's arrival process independently of responses,
+ * 		each arrival is a conversation and its latency is measured from the intended arrival time,
+ * 		so slow responses do not delay (and hide) following requests.
+ */
 class ClientInstance : public Application, public InstanceCounter
 {
 private:
-	const Ptr<Client>				m_client;
-	const Ptr<SimulationOutput> 	m_simulationOutput;
-	Ptr<ExecutionPlanExecuter>		m_planExecuter;
+	const Ptr<Client>							m_client;
+	const Ptr<SimulationOutput> 				m_simulationOutput;
+	Ptr<ExecutionPlanExecuter>					m_planExecuter;
+	// open loop arrivals
+	Ptr<ClientExecutionPlan>					m_clientPlan;
+	map<uint32_t, Ptr<ClientConversation> >		m_conversations;
+	EventId										m_arrivalEvent;
+	Time										m_arrivalsStartTime;
+	Time										m_nextArrivalTime;
+	uint32_t									m_arrivalCounter;
+
+	static uint32_t								s_numberOfArrivals;
+	static uint32_t								s_numberOfSuccessfulArrivals;
+	static uint32_t								s_numberOfFailedArrivals;
+	static Time									s_arrivalLatency;
+	static Time									s_maxArrivalLatency;
 
 public:
 
 	ClientInstance (Ptr<Client> client, Ptr<SimulationOutput> simulationOutput)
 		:InstanceCounter(typeid(this).name()),
 		 m_client (client),
-		 m_simulationOutput(simulationOutput)
+		 m_simulationOutput(simulationOutput),
+		 m_arrivalCounter (0)
 	{
 		NS_ASSERT(client != NULL);
 		NS_ASSERT(simulationOutput != NULL);
@@ -4414,6 +10842,14 @@ public:
 
 	virtual ~ClientInstance() {}
 
+	static uint32_t GetNumberOfArrivals () { return s_numberOfArrivals; }
+	static uint32_t GetNumberOfSuccessfulArrivals () { return s_numberOfSuccessfulArrivals; }
+	static uint32_t GetNumberOfFailedArrivals () { return s_numberOfFailedArrivals; }
+	// stopped with their client or still in flight at the end of the run
+	static uint32_t GetNumberOfUnfinishedArrivals () { return s_numberOfArrivals - s_numberOfSuccessfulArrivals - s_numberOfFailedArrivals; }
+	static Time GetArrivalLatency () { return s_arrivalLatency; }
+	static Time GetMaxArrivalLatency () { return s_maxArrivalLatency; }
+
 private:
 
 	virtual void StartApplication (void)
@@ -4421,6 +10857,14 @@ private:
 		Ptr<ClientExecutionPlan> 			clientExecutionPlan = DynamicCast<ClientExecutionPlan>(m_client->GetExecutionPlan());
 
 
+		if (clientExecutionPlan->GetArrivalProcess() != ClientExecutionPlan::ArrivalClosedLoop)
+		{
+			m_clientPlan = clientExecutionPlan;
+			m_arrivalsStartTime = Simulator::Now();
+			ScheduleNextArrival();
+			return;
+		}
+
 		m_planExecuter = CreateObject<ClientExecutionPlanExecuter>(
 								GetNode(),
 								m_client,
@@ -4428,20 +10872,119 @@ private:
 								m_simulationOutput,
 								clientExecutionPlan);
 
-		m_planExecuter->Start();
-	}
+		m_planExecuter->Start();
+	}
+
+	virtual void StopApplication (void)
+	{
+		if (m_planExecuter != NULL)
+		{
+			m_planExecuter->Stop();
+			m_planExecuter = NULL;
+		}
+
+		m_arrivalEvent.Cancel();
+
+		for (map<uint32_t, Ptr<ClientConversation> >::iterator it = m_conversations.begin(); it != m_conversations.end(); it++)
+		{
+			it->second->Stop();
+		}
+
+		m_conversations.clear();
+	}
+
+	void ScheduleNextArrival ()
+	{
+		const vector<Time> &		trace = m_clientPlan->GetArrivalTrace();
+
+
+		if (m_clientPlan->GetArrivalProcess() == ClientExecutionPlan::ArrivalTrace)
+		{
+			// end of the trace
+			if (m_arrivalCounter >= trace.size())
+			{
+				return;
+			}
+
+			m_nextArrivalTime = m_arrivalsStartTime + trace[m_arrivalCounter];
+		}
+		else
+		{
+			m_nextArrivalTime = Simulator::Now() + NanoSeconds((uint64_t)(m_clientPlan->GetArrivalInterval().GetValue() * 1000000));
+		}
+
+		m_arrivalEvent = Simulator::Schedule(
+				m_nextArrivalTime - Simulator::Now(),
+				&ClientInstance::OnArrival,
+				this);
+	}
+
+	void OnArrival ()
+	{
+		Ptr<ClientConversation>		conversation;
+
+
+		m_arrivalCounter++;
+		s_numberOfArrivals++;
+
+		conversation = CreateObject<ClientConversation>(
+				GetNode(),
+				m_client,
+				m_simulationOutput,
+				m_clientPlan,
+				m_arrivalCounter,
+				m_nextArrivalTime,
+				MakeCallback(&ClientInstance::OnConversationFinished, this));
+
+		m_conversations[m_arrivalCounter] = conversation;
+
+		// next arrival does not depend on this one
+		ScheduleNextArrival();
+
+		conversation->Start();
+	}
+
+	void OnConversationFinished (Ptr<ClientConversation> conversation, bool success)
+	{
+		NS_ASSERT(conversation != NULL);
+
+		Time		latency = Simulator::Now() - conversation->GetIntendedStartTime();
+
+
+		if (success)
+		{
+			s_numberOfSuccessfulArrivals++;
+		}
+		else
+		{
+			s_numberOfFailedArrivals++;
+		}
+
+		s_arrivalLatency += latency;
 
-	virtual void StopApplication (void)
-	{
-		if (m_planExecuter != NULL)
+		if (latency > s_maxArrivalLatency)
 		{
-			m_planExecuter->Stop();
-			m_planExecuter = NULL;
+			s_maxArrivalLatency = latency;
 		}
+
+		m_simulationOutput->RecordArrival(
+				m_client->GetServiceId(),
+				conversation->GetArrivalId(),
+				conversation->GetIntendedStartTime(),
+				latency,
+				success);
+
+		m_conversations.erase(conversation->GetArrivalId());
 	}
 
 }; // ClientInstance
 
+uint32_t ClientInstance::s_numberOfArrivals = 0;
+uint32_t ClientInstance::s_numberOfSuccessfulArrivals = 0;
+uint32_t ClientInstance::s_numberOfFailedArrivals = 0;
+Time ClientInstance::s_arrivalLatency = Seconds(0);
+Time ClientInstance::s_maxArrivalLatency = Seconds(0);
+
 
 class ServiceConfigurationRandomGenerator
 {
@@ -5266,6 +11809,7 @@ private:
 	const bool							m_writeOut;
 	ApplicationContainer 				m_clientContainer;
 	ApplicationContainer 				m_serviceContainer;
+	RandomVariable						m_nodeSelector;
 
 public:
 
@@ -5283,7 +11827,8 @@ public:
 		 m_servicePortBaseId (servicePortBaseId),
 		 m_fixedNodeAssignments(fixedNodeAssignments),
 		 m_fixedNodeAssignmentsSize(fixedNodeAssignmentsSize),
-		 m_writeOut (writeOut)
+		 m_writeOut (writeOut),
+		 m_nodeSelector (UniformVariable (0, 1))
 	{
 		NS_ASSERT(nodes.GetN() > 0);
 		NS_ASSERT(simulationOutput != NULL);
@@ -5301,6 +11846,7 @@ public:
 		 }
 		 else
 		 {
+			 m_serviceConfiguration->FinalizeExecutionPlans();
 			 InstantiateClients();
 			 InstantiateServices();
 		 }
@@ -5440,11 +11986,12 @@ private:
 		}
 	}
 
+	// replicas of a contract are deployed together - each on a different node (anti-affinity)
 	void InstantiateServices ()
 	{
-		const map<uint32_t, Ptr<Service> > &				services = m_serviceConfiguration->GetServices();
-		map<uint32_t, Ptr<Service> >::const_iterator		it;
-		set<pair<uint32_t, uint32_t> >						contractToNodeAssignments;
+		const map<uint32_t, vector<Ptr<Service> > > &				contracts = m_serviceConfiguration->GetContracts();
+		map<uint32_t, vector<Ptr<Service> > >::const_iterator		it;
+		vector<uint32_t>											nodeIds;
 
 
 		if (m_writeOut)
@@ -5452,25 +11999,28 @@ private:
 			NS_LOG_UNCOND("Instantiating services ...");
 		}
 
-		for (it = services.begin(); it != services.end(); it++)
+		for (it = contracts.begin(); it != contracts.end(); it++)
 		{
-			InstantiateService(it->second, contractToNodeAssignments);
+			FindNodesForReplicaSetDeployment(it->second, nodeIds);
+
+			for (uint32_t i = 0; i < it->second.size(); i++)
+			{
+				InstantiateService(it->second[i], nodeIds[i]);
+			}
 		}
 	}
 
 	void InstantiateService (
 			Ptr<Service> service,
-			set<pair<uint32_t, uint32_t> > & contractToNodeAssignments)
+			uint32_t nodeId)
 	{
 		NS_ASSERT(service != NULL);
 
 		Ptr<ServiceInstance>		serviceInstance;
-		uint32_t					nodeId;
 		Ptr<Node> 					node;
 		uint16_t					portId;
 
 
-		nodeId = FindNodeForServiceDeployment(service, contractToNodeAssignments);
 		node = m_nodes.Get(nodeId);
 		portId = m_servicePortBaseId + node->GetNApplications();
 		serviceInstance = CreateObject<ServiceInstance>(service, portId, m_simulationOutput);
@@ -5496,40 +12046,337 @@ private:
 		serviceInstance->SetStopTime(service->GetStopTime());
 	}
 
-	uint32_t FindNodeForServiceDeployment(
-			Ptr<Service> service,
-			set<pair<uint32_t, uint32_t> > & contractToNodeAssignments)
+	/*
+	 * Fixed node assignments are kept, other replicas are placed on distinct nodes drawn
+	 * uniformly from the nodes not used by the contract yet.
+	 * If the contract has more replicas than nodes, anti-affinity cant be kept - nodes are reused.
+	 * */
+	void FindNodesForReplicaSetDeployment(
+			const vector<Ptr<Service> > & services,
+			vector<uint32_t> & nodeIds)
 	{
-		NS_ASSERT(service != NULL);
+		set<uint32_t>				usedNodes;
+		vector<uint32_t>			candidateNodes;
+		uint32_t					index;
 
-		Ptr<ServiceInstance>		serviceInstance;
-		uint32_t					nodeId;
-		pair<uint32_t, uint32_t>	contractToNode;
 
+		nodeIds.assign(services.size(), NodeAssignment::NODE_ASSIGNMENT_NOT_FOUND);
+
+		for (uint32_t i = 0; i < services.size(); i++)
+		{
+			nodeIds[i] = GetFixedNodeAssignment(services[i]->GetServiceId());
+
+			if (nodeIds[i] != NodeAssignment::NODE_ASSIGNMENT_NOT_FOUND)
+			{
+				usedNodes.insert(nodeIds[i]);
+			}
+		}
+
+		for (uint32_t i = 0; i < services.size(); i++)
+		{
+			if (nodeIds[i] != NodeAssignment::NODE_ASSIGNMENT_NOT_FOUND)
+			{
+				continue;
+			}
+
+			if (candidateNodes.empty())
+			{
+				if (usedNodes.size() >= m_nodes.GetN())
+				{
+					NS_LOG_UNCOND("	warning: contract " << services[i]->GetContractId() << " has more replicas than nodes, replicas share nodes");
+					usedNodes.clear();
+				}
+
+				for (uint32_t n = 0; n < m_nodes.GetN(); n++)
+				{
+					if (usedNodes.find(n) == usedNodes.end())
+					{
+						candidateNodes.push_back(n);
+					}
+				}
+			}
+
+			// draw without replacement
+			index = (uint32_t) (m_nodeSelector.GetValue() * candidateNodes.size());
+			index = (index < candidateNodes.size()) ? index : candidateNodes.size() - 1;
+
+			nodeIds[i] = candidateNodes[index];
+			usedNodes.insert(nodeIds[i]);
+
+			candidateNodes[index] = candidateNodes.back();
+			candidateNodes.pop_back();
+		}
+	}
+
+}; // SimulationLoader
+
+/*
+ * Starts and retires replicas of contracts at runtime
+ *
+ * How it works
+ *
+ * Each sampling period request rate and mean response time of each contract are taken from
+ * the registry. Desired number of replicas covers the request rate by target rate per replica,
+ * one more replica is desired when the mean response time exceeds the target. Scale up starts
+ * a replica of the contract's first service on a random node not hosting the contract, scale
+ * down retires an idle replica started by the autoscaler (deployed services are never retired).
+ * After a scale event the contract is left alone for the cooldown period.
+ * */
+class ServiceAutoscaler : public Object
+{
+private:
+
+	struct ContractState
+	{
+		ServiceRegistry::ContractLoad		lastLoad;
+		Time								lastScaleEvent;
+		// replicas started by the autoscaler
+		vector<Ptr<ServiceInstance> >		replicas;
+	};
+
+	const NodeContainer 				m_nodes;
+	const Ptr<ServiceConfiguration>		m_serviceConfiguration;
+	const Ptr<SimulationOutput>			m_simulationOutput;
+	const uint16_t						m_servicePortBaseId;
+	const Time							m_samplingPeriod;
+	const double						m_targetRatePerReplica; // requests per second
+	const Time							m_targetResponseTime;
+	const uint32_t						m_maxAddedReplicas;
+	const Time							m_cooldown;
+	RandomVariable						m_nodeSelector;
+	EventId								m_sampleEvent;
+	uint32_t							m_nextServiceId;
+	// key is contractId
+	map<uint32_t, ContractState>		m_contractStates;
+
+	static uint32_t						s_numberOfScaleUps;
+	static uint32_t						s_numberOfScaleDowns;
+
+public:
+
+	ServiceAutoscaler (
+			NodeContainer nodes,
+			Ptr<ServiceConfiguration> serviceConfiguration,
+			Ptr<SimulationOutput> simulationOutput,
+			uint16_t servicePortBaseId,
+			Time samplingPeriod,
+			double targetRatePerReplica,
+			Time targetResponseTime,
+			uint32_t maxAddedReplicas,
+			Time cooldown)
+	:m_nodes(nodes),
+	 m_serviceConfiguration(serviceConfiguration),
+	 m_simulationOutput(simulationOutput),
+	 m_servicePortBaseId(servicePortBaseId),
+	 m_samplingPeriod(samplingPeriod),
+	 m_targetRatePerReplica(targetRatePerReplica),
+	 m_targetResponseTime(targetResponseTime),
+	 m_maxAddedReplicas(maxAddedReplicas),
+	 m_cooldown(cooldown),
+	 m_nodeSelector(UniformVariable(0, 1)),
+	 m_nextServiceId(1)
+	{
+		NS_ASSERT(nodes.GetN() > 0);
+		NS_ASSERT(serviceConfiguration != NULL);
+		NS_ASSERT(simulationOutput != NULL);
+		NS_ASSERT(targetRatePerReplica > 0);
+	}
+
+	virtual ~ServiceAutoscaler ()
+	{
+		m_sampleEvent.Cancel();
+	}
 
-		nodeId = GetFixedNodeAssignment(service->GetServiceId());
+	void Start ()
+	{
+		// ids of new replicas follow all configured ids
+		if (!m_serviceConfiguration->GetServices().empty())
+		{
+			m_nextServiceId = max(m_nextServiceId, m_serviceConfiguration->GetServices().rbegin()->first + 1);
+		}
 
-		if (nodeId != NodeAssignment::NODE_ASSIGNMENT_NOT_FOUND)
+		if (!m_serviceConfiguration->GetClients().empty())
 		{
-			return nodeId;
+			m_nextServiceId = max(m_nextServiceId, m_serviceConfiguration->GetClients().rbegin()->first + 1);
 		}
 
-		while(true)
+		m_sampleEvent = Simulator::Schedule (m_samplingPeriod, &ServiceAutoscaler::Sample, this);
+	}
+
+	static uint32_t GetNumberOfScaleUps () { return s_numberOfScaleUps; }
+	static uint32_t GetNumberOfScaleDowns () { return s_numberOfScaleDowns; }
+
+private:
+
+	void Sample ()
+	{
+		const map<uint32_t, vector<Ptr<Service> > > &				contracts = m_serviceConfiguration->GetContracts();
+		map<uint32_t, vector<Ptr<Service> > >::const_iterator		it;
+		ServiceRegistry::ContractLoad								load;
+		uint32_t													contractId;
+		uint32_t													replicas;
+		uint32_t													desiredReplicas;
+		uint32_t													responses;
+		double														requestRate;
+		double														meanResponseTime;
+		char														action;
+
+
+		for (it = contracts.begin(); it != contracts.end(); it++)
 		{
-			nodeId = RandomSelectNodeForDeployment();
-			contractToNode = pair<uint32_t, uint32_t>(service->GetContractId(), nodeId);
+			contractId = it->first;
+			ContractState &			state = m_contractStates[contractId];
 
-			if (contractToNodeAssignments.find(contractToNode) == contractToNodeAssignments.end())
+
+			load = ServiceRegistry::GetContractLoad(contractId);
+			responses = load.responses - state.lastLoad.responses;
+			requestRate = (load.requests - state.lastLoad.requests) / m_samplingPeriod.GetSeconds();
+			meanResponseTime = (responses == 0) ? 0 : (load.responseTimeSum - state.lastLoad.responseTimeSum) / responses;
+			replicas = ServiceRegistry::GetServiceRecords(contractId).size();
+			action = '-';
+
+			state.lastLoad = load;
+
+			if (replicas > 0 && Simulator::Now() - state.lastScaleEvent >= m_cooldown)
+			{
+				desiredReplicas = (uint32_t) ceil(requestRate / m_targetRatePerReplica);
+
+				if (meanResponseTime > m_targetResponseTime.GetMilliSeconds())
+				{
+					desiredReplicas = max(desiredReplicas, replicas + 1);
+				}
+
+				if (desiredReplicas > replicas && state.replicas.size() < m_maxAddedReplicas)
+				{
+					if (ScaleUp(contractId, state))
+					{
+						action = 'u';
+					}
+				}
+				else if (desiredReplicas < replicas && !state.replicas.empty())
+				{
+					if (ScaleDown(contractId, state))
+					{
+						action = 'd';
+					}
+				}
+			}
+
+			if (action != '-')
 			{
-				contractToNodeAssignments.insert(contractToNode);
-				return nodeId;
+				NS_LOG_UNCOND("Autoscaler - time: " << Simulator::Now().GetSeconds()
+						<< "s, contract: " << contractId
+						<< ", action: " << (action == 'u' ? "scale up" : "scale down")
+						<< ", replicas: " << ServiceRegistry::GetServiceRecords(contractId).size()
+						<< ", request rate: " << requestRate
+						<< ", mean response time: " << meanResponseTime << "ms");
 			}
+
+			m_simulationOutput->RecordScalingSample(
+					contractId,
+					action,
+					ServiceRegistry::GetServiceRecords(contractId).size(),
+					requestRate,
+					meanResponseTime);
 		}
 
-		return NULL;
+		m_sampleEvent = Simulator::Schedule (m_samplingPeriod, &ServiceAutoscaler::Sample, this);
 	}
 
-}; // SimulationLoader
+	bool ScaleUp (uint32_t contractId, ContractState & state)
+	{
+		const vector<Ptr<ServiceRegistryRecord> > &		records = ServiceRegistry::GetServiceRecords(contractId);
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator	rit;
+		set<uint32_t>									contractNodes;
+		vector<uint32_t>								candidateNodes;
+		uint32_t										serviceId = m_nextServiceId;
+		uint32_t										index;
+		Ptr<Node>										node;
+		Ptr<ServiceInstance>							serviceInstance;
+
+
+		for (rit = records.begin(); rit != records.end(); rit++)
+		{
+			contractNodes.insert((*rit)->GetNodeId());
+		}
+
+		// anti-affinity - node not hosting the contract
+		for (uint32_t n = 0; n < m_nodes.GetN(); n++)
+		{
+			if (contractNodes.find(m_nodes.Get(n)->GetId()) == contractNodes.end())
+			{
+				candidateNodes.push_back(n);
+			}
+		}
+
+		if (candidateNodes.empty())
+		{
+			return false;
+		}
+
+		index = (uint32_t) (m_nodeSelector.GetValue() * candidateNodes.size());
+		node = m_nodes.Get(candidateNodes[index < candidateNodes.size() ? index : candidateNodes.size() - 1]);
+
+		m_nextServiceId++;
+		m_serviceConfiguration->AddServiceReplica(
+				m_serviceConfiguration->GetContractServices(contractId).front()->GetServiceId(),
+				serviceId);
+
+		serviceInstance = CreateObject<ServiceInstance>(
+				m_serviceConfiguration->GetService(serviceId),
+				m_servicePortBaseId + node->GetNApplications(),
+				m_simulationOutput);
+
+		// registers itself when started
+		node->AddApplication(serviceInstance);
+		serviceInstance->SetStartTime(Seconds(0));
+
+		state.replicas.push_back(serviceInstance);
+		state.lastScaleEvent = Simulator::Now();
+		s_numberOfScaleUps++;
+
+		return true;
+	}
+
+	bool ScaleDown (uint32_t contractId, ContractState & state)
+	{
+		const vector<Ptr<ServiceRegistryRecord> > &		records = ServiceRegistry::GetServiceRecords(contractId);
+		vector<Ptr<ServiceRegistryRecord> >::const_iterator	rit;
+		vector<Ptr<ServiceInstance> >::iterator			it;
+
+
+		// latest replica first - idle only (no outstanding requests sent to it, no tasks held by the instance)
+		for (it = state.replicas.end(); it != state.replicas.begin(); )
+		{
+			it--;
+
+			if (!(*it)->IsIdle())
+			{
+				continue;
+			}
+
+			for (rit = records.begin(); rit != records.end(); rit++)
+			{
+				if ((*rit)->GetService() == (*it)->GetService() && (*rit)->GetOutstandingRequests() == 0)
+				{
+					(*it)->Retire();
+					state.replicas.erase(it);
+					state.lastScaleEvent = Simulator::Now();
+					s_numberOfScaleDowns++;
+
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+}; // ServiceAutoscaler
+
+uint32_t ServiceAutoscaler::s_numberOfScaleUps = 0;
+uint32_t ServiceAutoscaler::s_numberOfScaleDowns = 0;
+
 
 class NetworkConfigurationGenerator
 {
@@ -7394,6 +14241,8 @@ private:
 	struct timeval 						m_simulationStartTime;
 	const NodeAssignment * 				m_fixedNodeAssignments;
 	const uint32_t 						m_fixedNodeAssignmentsSize;
+	Ptr<ServiceAutoscaler>				m_autoscaler;
+	Time								m_simulationRunLength;
 
 
 public:
@@ -7413,6 +14262,145 @@ public:
 
 	virtual ~ScenarioSimulation () {}
 
+	// optional - processing delays of services are work demands on cpu of their node
+	void EnableNodeCpu (
+			uint32_t cores,
+			NodeCpuRegistry::Scheduling scheduling)
+	{
+		NodeCpuRegistry::Enable(cores, scheduling);
+	}
+
+	// optional - bounded concurrency of services, queue events are traced to queue.csv
+	void ConfigureServiceWorkerPool (
+			uint32_t workerSlots,
+			uint32_t queueCapacity,
+			ServiceInstance::QueueDiscipline queueDiscipline,
+			ServiceInstance::OverflowPolicy overflowPolicy)
+	{
+		m_simulationOutput->OpenQueueOutput("queue.csv");
+
+		ServiceInstance::ConfigureWorkerPool(
+				workerSlots,
+				queueCapacity,
+				queueDiscipline,
+				overflowPolicy);
+	}
+
+	// optional - requests are admitted by the server endpoints of services, decisions are traced to admission.csv
+	void ConfigureAdmissionControl (
+			AdmissionController::Policy policy,
+			uint32_t limit,
+			Time target,
+			Time interval)
+	{
+		m_simulationOutput->OpenAdmissionOutput("admission.csv");
+
+		ServiceInstance::ConfigureAdmissionControl(
+				policy,
+				limit,
+				target,
+				interval);
+	}
+
+	// optional - conversations carry deadlines (client response timeout), work after them is avoided
+	void EnableDeadlinePropagation ()
+	{
+		Message::EnableDeadlinePropagation();
+	}
+
+	// optional - callers fail fast on destinations failing repeatedly, transitions are traced to breaker.csv
+	void EnableCircuitBreakers (
+			CircuitBreakerRegistry::Scope scope,
+			uint32_t failureThreshold,
+			Time openPeriod)
+	{
+		m_simulationOutput->OpenBreakerOutput("breaker.csv");
+
+		CircuitBreakerRegistry::Enable(
+				scope,
+				failureThreshold,
+				openPeriod,
+				m_simulationOutput);
+	}
+
+	// optional - requests in progress at the stop of a service are answered with exception
+	void EnableExceptionsOnServiceStop ()
+	{
+		ServiceInstance::EnableExceptionsOnStop();
+	}
+
+	// optional - conversations of open loop clients are traced to arrival.csv
+	void EnableArrivalTrace ()
+	{
+		m_simulationOutput->OpenArrivalOutput("arrival.csv");
+	}
+
+	// optional - concurrent calls of the same contract method by service tasks of a node share one request
+	void EnableRequestCoalescing ()
+	{
+		CoalescedRequest::Enable();
+	}
+
+	// optional - lookups of response caches of methods are traced to cache.csv
+	void EnableResponseCacheTrace ()
+	{
+		m_simulationOutput->OpenCacheOutput("cache.csv");
+	}
+
+	// optional - hedged steps are traced to hedge.csv
+	void EnableHedgeTrace ()
+	{
+		m_simulationOutput->OpenHedgeOutput("hedge.csv");
+	}
+
+	// optional - joins of parallel step groups are traced to group.csv
+	void EnableParallelGroupTrace ()
+	{
+		m_simulationOutput->OpenGroupOutput("group.csv");
+	}
+
+	// optional - replicas are started and retired at runtime, samples are traced to scale.csv
+	void EnableAutoscaling (
+			Time samplingPeriod,
+			double targetRatePerReplica,
+			Time targetResponseTime,
+			uint32_t maxAddedReplicas,
+			Time cooldown)
+	{
+		NS_ASSERT(m_autoscaler == NULL);
+
+		m_simulationOutput->OpenScalingOutput("scale.csv");
+
+		m_autoscaler = CreateObject<ServiceAutoscaler>(
+				m_nodes,
+				m_serviceConfiguration,
+				m_simulationOutput,
+				SERVICE_PORT_BASE_ID, // uint16_t servicePortBaseId
+				samplingPeriod,
+				targetRatePerReplica,
+				targetResponseTime,
+				maxAddedReplicas,
+				cooldown);
+
+		m_autoscaler->Start();
+	}
+
+	// optional - services are discovered over the network, discovery traffic is traced to disc.csv
+	void EnableServiceDiscovery (
+			Time announcementPeriod,
+			Time cacheTtl,
+			uint32_t hopLimit)
+	{
+		m_simulationOutput->OpenDiscoveryOutput("disc.csv");
+
+		ServiceRegistry::EnableDiscovery(
+				m_nodes,
+				m_simulationOutput,
+				announcementPeriod,
+				cacheTtl,
+				hopLimit);
+	}
+
 	void RunSimulation (
 			Time simulationRunLength,
 			bool writeOutServiceConfigurationStatistics,
@@ -7433,6 +14421,7 @@ public:
 		NS_LOG_UNCOND("	... this may take some time ...");
 
 		InitializeSimulationStartTime();
+		m_simulationRunLength = simulationRunLength;
 
 		if (writeOutSimulationTimeProgress)
 		{
@@ -7441,6 +14430,10 @@ public:
 
 		Simulator::Stop(simulationRunLength);
 		Simulator::Run();
+		NodeCpuRegistry::FlushUtilization();
+		ServiceInstance::FlushUtilization();
+		ServiceTaskManager::ClearTaskPool();
+		CoalescedRequest::Clear();
 		Simulator::Destroy ();
 
 		NS_LOG_UNCOND("Simulation finished successfully");
@@ -7487,7 +14480,9 @@ private:
 
 	void WriteOutSimulationTimingOutput ()
 	{
-		NS_LOG_UNCOND("	Simulation time: " << Simulator::Now().GetSeconds() << "s - elapsed real time: " << GetSimulationTimeElapsed() << "s");
+		NS_LOG_UNCOND("	Simulation time: " << Simulator::Now().GetSeconds() << "s - elapsed real time: " << GetSimulationTimeElapsed() << "s"
+				<< " - live tasks: " << ServiceTaskManager::GetNumberOfLiveTasks()
+				<< " (pooled: " << ServiceTaskManager::GetNumberOfPooledTasks() << ")");
 		//InstanceCounter::WriteOut();
 		Simulator::Schedule (MilliSeconds(1000), &ScenarioSimulation::WriteOutSimulationTimingOutput, this);
 	}
@@ -7511,7 +14506,7 @@ private:
 				m_nodes, // NodeContainer nodes,
 				m_simulationOutput, //Ptr<SimulationOutput> simulationOutput,
 				m_serviceConfiguration, // Ptr<ServiceConfiguration> serviceConfiguration,
-				10000, // uint16_t servicePortBaseId
+				SERVICE_PORT_BASE_ID, // uint16_t servicePortBaseId
 				m_fixedNodeAssignments, // NodeAssignment[] fixedNodeAssignments,
 				m_fixedNodeAssignmentsSize, // uint32_t fixedNodeAssignmentsSize,
 				writeOutSimulationLoadingInfo); // bool writeOut
@@ -7606,6 +14601,134 @@ private:
 		NS_LOG_UNCOND("		Service method - number of failed methods: " << ServiceRequestTask::GetNumberOfFailedMethods());
 		NS_LOG_UNCOND("		Service method - number of failed methods (including fault propagation): " << ServiceRequestTask::GetNumberOfFailedExecutions());
 		NS_LOG_UNCOND("		Service - number of issued exception response messages: " << ServiceRequestTask::GetNumberOfIssuedExceptionMessages());
+		NS_LOG_UNCOND("		Service tasks - created: " << ServiceTaskManager::GetNumberOfCreatedTasks() << ", reused: " << ServiceTaskManager::GetNumberOfReusedTasks());
+		NS_LOG_UNCOND("		Service tasks - cancelled by stopped services: " << ServiceRequestTask::GetNumberOfCancelledTasks());
+		NS_LOG_UNCOND("		Service tasks - live at the end of the run: " << ServiceTaskManager::GetNumberOfLiveTasks());
+
+		if (ServiceInstance::GetNumberOfWorkerSlots() > 0)
+		{
+			NS_LOG_UNCOND("		Worker pool - number of queued requests: " << ServiceInstance::GetNumberOfQueuedRequests());
+			NS_LOG_UNCOND("		Worker pool - number of rejected requests: " << ServiceInstance::GetNumberOfRejectedRequests());
+			NS_LOG_UNCOND("		Worker pool - number of dropped requests: " << ServiceInstance::GetNumberOfDroppedRequests());
+			NS_LOG_UNCOND("		Worker pool - mean queue wait time (ms): " <<
+					((ServiceInstance::GetNumberOfDequeuedRequests() == 0) ? 0 : ServiceInstance::GetQueueWaitTime().GetSeconds() * 1000 / ServiceInstance::GetNumberOfDequeuedRequests()));
+			NS_LOG_UNCOND("		Worker pool - utilization (busy time of all slots over their instances' running time): " <<
+					((ServiceInstance::GetWorkerSlotTime().IsZero()) ? 0 : ServiceInstance::GetBusyWorkerTime().GetSeconds() / ServiceInstance::GetWorkerSlotTime().GetSeconds()));
+		}
+
+		if (AdmissionController::GetNumberOfAdmittedRequests() + AdmissionController::GetNumberOfRejectedRequests() > 0)
+		{
+			NS_LOG_UNCOND("		Admission control - number of admitted requests: " << AdmissionController::GetNumberOfAdmittedRequests());
+			NS_LOG_UNCOND("		Admission control - number of rejected requests: " << AdmissionController::GetNumberOfRejectedRequests());
+		}
+
+		if (ClientRateLimiter::IsUsed())
+		{
+			NS_LOG_UNCOND("		Rate limiting - number of limited requests: " << ServiceInstance::GetNumberOfRateLimitedRequests());
+			ClientRateLimiter::WriteOutClientCounts();
+		}
+
+		if (ClientInstance::GetNumberOfArrivals() > 0)
+		{
+			uint32_t		finishedArrivals = ClientInstance::GetNumberOfSuccessfulArrivals() + ClientInstance::GetNumberOfFailedArrivals();
+
+			NS_LOG_UNCOND("		Open loop clients - number of arrivals: " << ClientInstance::GetNumberOfArrivals());
+			NS_LOG_UNCOND("		Open loop clients - number of successful conversations: " << ClientInstance::GetNumberOfSuccessfulArrivals());
+			NS_LOG_UNCOND("		Open loop clients - number of failed conversations: " << ClientInstance::GetNumberOfFailedArrivals());
+			NS_LOG_UNCOND("		Open loop clients - number of unfinished conversations: " << ClientInstance::GetNumberOfUnfinishedArrivals());
+			NS_LOG_UNCOND("		Open loop clients - mean latency from intended start (ms): " <<
+					((finishedArrivals == 0) ? 0 : ClientInstance::GetArrivalLatency().GetMilliSeconds() / finishedArrivals));
+			NS_LOG_UNCOND("		Open loop clients - max latency from intended start (ms): " << ClientInstance::GetMaxArrivalLatency().GetMilliSeconds());
+		}
+
+		if (ExecutionPlanExecuter::GetNumberOfGroups() > 0)
+		{
+			NS_LOG_UNCOND("		Parallel groups - number of executed groups: " << ExecutionPlanExecuter::GetNumberOfGroups());
+			NS_LOG_UNCOND("		Parallel groups - number of joined groups: " << ExecutionPlanExecuter::GetNumberOfJoinedGroups());
+			NS_LOG_UNCOND("		Parallel groups - number of abandoned calls: " << ExecutionPlanExecuter::GetNumberOfAbandonedGroupRequests());
+			NS_LOG_UNCOND("		Parallel groups - mean latency (ms): " <<
+					ExecutionPlanExecuter::GetGroupLatency().GetMilliSeconds() / ExecutionPlanExecuter::GetNumberOfGroups());
+		}
+
+		if (CoalescedRequest::IsEnabled())
+		{
+			NS_LOG_UNCOND("		Request coalescing - number of sent requests: " << CoalescedRequest::GetNumberOfRequests());
+			NS_LOG_UNCOND("		Request coalescing - number of calls attached to outstanding requests: " << CoalescedRequest::GetNumberOfCoalescedCalls());
+		}
+
+		if (ResponseCache::GetNumberOfHits() + ResponseCache::GetNumberOfMisses() > 0)
+		{
+			NS_LOG_UNCOND("		Response caches - number of hits: " << ResponseCache::GetNumberOfHits());
+			NS_LOG_UNCOND("		Response caches - number of misses: " << ResponseCache::GetNumberOfMisses());
+			NS_LOG_UNCOND("		Response caches - hit ratio: " <<
+					(double)ResponseCache::GetNumberOfHits() / (ResponseCache::GetNumberOfHits() + ResponseCache::GetNumberOfMisses()));
+		}
+
+		if (ExecutionPlanExecuter::GetNumberOfHedgedSteps() > 0)
+		{
+			NS_LOG_UNCOND("		Hedged steps - number of executed steps: " << ExecutionPlanExecuter::GetNumberOfHedgedSteps());
+			NS_LOG_UNCOND("		Hedged steps - number of hedge requests (extra load): " << ExecutionPlanExecuter::GetNumberOfHedgeRequests()
+					<< " (" << 100.0 * ExecutionPlanExecuter::GetNumberOfHedgeRequests() / ExecutionPlanExecuter::GetNumberOfHedgedSteps() << "% of steps)");
+			NS_LOG_UNCOND("		Hedged steps - number of steps won by hedge requests: " << ExecutionPlanExecuter::GetNumberOfHedgeWins());
+			NS_LOG_UNCOND("		Hedged steps - number of abandoned hedge requests: " << ExecutionPlanExecuter::GetNumberOfAbandonedHedgedRequests());
+			NS_LOG_UNCOND("		Hedged steps - mean latency (ms): " <<
+					ExecutionPlanExecuter::GetHedgedStepLatency().GetMilliSeconds() / ExecutionPlanExecuter::GetNumberOfHedgedSteps());
+			NS_LOG_UNCOND("		Hedged steps - mean latency of steps won by hedge requests (ms): " <<
+					((ExecutionPlanExecuter::GetNumberOfHedgeWins() == 0) ? 0 : ExecutionPlanExecuter::GetHedgeWinLatency().GetMilliSeconds() / ExecutionPlanExecuter::GetNumberOfHedgeWins()));
+		}
+
+		if (Message::IsDeadlinePropagated())
+		{
+			NS_LOG_UNCOND("		Deadlines - expired requests dropped (on arrival or in queue): " << ServiceInstance::GetNumberOfExpiredRequests());
+			NS_LOG_UNCOND("		Deadlines - executions with skipped steps: " << ServiceExecutionPlanExecuter::GetNumberOfDeadlineAbortedExecutions());
+			NS_LOG_UNCOND("		Deadlines - responses not sent: " << ServiceRequestTask::GetNumberOfExpiredResponsesSkipped());
+			NS_LOG_UNCOND("		Deadlines - shortened response timeouts: " << UdpClientMessageEndpoint::GetNumberOfShortenedTimeouts());
+		}
+
+		if (CircuitBreakerRegistry::IsEnabled())
+		{
+			NS_LOG_UNCOND("		Circuit breakers - number of openings: " << CircuitBreakerRegistry::GetNumberOfOpenings());
+			NS_LOG_UNCOND("		Circuit breakers - number of closings: " << CircuitBreakerRegistry::GetNumberOfClosings());
+			NS_LOG_UNCOND("		Circuit breakers - number of probes: " << CircuitBreakerRegistry::GetNumberOfProbes());
+			NS_LOG_UNCOND("		Circuit breakers - number of requests failed fast: " << CircuitBreakerRegistry::GetNumberOfRejectedRequests());
+		}
+
+		NS_LOG_UNCOND("		Registry - number of deregistered services: " << ServiceRegistry::GetNumberOfDeregistrations());
+		NS_LOG_UNCOND("		Registry - number of suspected services: " << ServiceRegistry::GetNumberOfSuspicions());
+		NS_LOG_UNCOND("		Registry - number of unanswered requests to stopped services: " << ServiceRegistry::GetNumberOfRequestsToDeadServices());
+		NS_LOG_UNCOND("		Registry - time wasted on stopped services (s): " << ServiceRegistry::GetTimeWastedOnDeadServices().GetSeconds());
+
+		if (ServiceRegistryServiceSelectorConsistentHash::GetNumberOfSelections() > 0)
+		{
+			NS_LOG_UNCOND("		Consistent hashing - number of selections: " << ServiceRegistryServiceSelectorConsistentHash::GetNumberOfSelections());
+			NS_LOG_UNCOND("		Consistent hashing - number of remapped selections: " << ServiceRegistryServiceSelectorConsistentHash::GetNumberOfRemappedSelections());
+			NS_LOG_UNCOND("		Consistent hashing - number of new conversations keyed by caller: " << ServiceRegistryServiceSelectorConsistentHash::GetNumberOfCallerKeyedSelections());
+		}
+
+		if (NodeCpuRegistry::IsEnabled())
+		{
+			NS_LOG_UNCOND("	Node CPU utilization ...");
+			NodeCpuRegistry::WriteOutUtilization(m_simulationRunLength);
+		}
+
+		if (m_autoscaler != NULL)
+		{
+			NS_LOG_UNCOND("	Autoscaler ...");
+			NS_LOG_UNCOND("		Scale ups: " << ServiceAutoscaler::GetNumberOfScaleUps());
+			NS_LOG_UNCOND("		Scale downs: " << ServiceAutoscaler::GetNumberOfScaleDowns());
+		}
+
+		if (ServiceRegistry::IsDiscoveryEnabled())
+		{
+			NS_LOG_UNCOND("	Discovery layer ...");
+			NS_LOG_UNCOND("		Announcements sent: " << ServiceDiscoveryAgent::GetNumberOfAnnouncementsSent());
+			NS_LOG_UNCOND("		Announcements forwarded: " << ServiceDiscoveryAgent::GetNumberOfAnnouncementsForwarded());
+			NS_LOG_UNCOND("		Announcements received: " << ServiceDiscoveryAgent::GetNumberOfAnnouncementsReceived());
+			NS_LOG_UNCOND("		Bytes sent: " << ServiceDiscoveryAgent::GetNumberOfBytesSent());
+			NS_LOG_UNCOND("		Lookups - cache hits: " << ServiceDiscoveryAgent::GetNumberOfCacheHits());
+			NS_LOG_UNCOND("		Lookups - cache misses (no service known): " << ServiceDiscoveryAgent::GetNumberOfCacheMisses());
+		}
+
 		NS_LOG_UNCOND("	Simulation ...");
 		NS_LOG_UNCOND("		Total number of all symptoms (including ACK timeouts etc): " << SimulationOutput::GetErrCounter());
 	}